@@ -12,7 +12,7 @@ NSTEPS_VALUES=(100 500 1000 2000 5000)
 # NSTEPS_VALUES=(1000)
 
 # Compilar el programa
-gcc -DUSE_CLOCK -O3 original-jacobi1d.c timing.c -o jacobi1d
+gcc -DUSE_CLOCK -O3 original-jacobi1d.c timing.c jacobi_kernels.c jacobi_opts.c multigrid.c tridiag.c dst.c -o jacobi1d -lm
 
 # Ejecutar benchmarks
 for N in "${N_VALUES[@]}"; do
@@ -25,4 +25,19 @@ for N in "${N_VALUES[@]}"; do
     done
 done
 
-echo "Benchmark completado. Resultados en resultados_benchmark.csv"
\ No newline at end of file
+# Jacobi contra los solvers exactos: puntos actualizados por segundo
+# (N*NSTEPS/TIEMPO para jacobi, N/TIEMPO para direct y fft)
+SOLVER_STEPS=1000
+echo "N,SOLVER,BARRIDOS,TIEMPO(s),PUNTOS/s" > resultados_benchmark_solvers.csv
+for N in "${N_VALUES[@]}"; do
+    for SOLVER in jacobi direct fft; do
+        STEPS=$([ "$SOLVER" = jacobi ] && echo $SOLVER_STEPS || echo 1)
+        echo "Ejecutando con N=$N, SOLVER=$SOLVER"
+        TIEMPO=$(./jacobi1d $N $STEPS --solver $SOLVER | grep "Elapsed time" | awk '{print $3}')
+        PPS=$(awk -v n=$N -v s=$STEPS -v t=$TIEMPO 'BEGIN { printf "%g", n*s/t }')
+        echo "$N,$SOLVER,$STEPS,$TIEMPO,$PPS" >> resultados_benchmark_solvers.csv
+        sleep 1
+    done
+done
+
+echo "Benchmark completado. Resultados en resultados_benchmark.csv y resultados_benchmark_solvers.csv"
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef DST_H_
+#define DST_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * Fast Poisson solver for the same problem as the Jacobi sweeps,
+ *
+ *    (-u[i-1] + 2 u[i] - u[i+1]) / h^2 = f[i],   0 < i < n,
+ *
+ * with Dirichlet values u[0] and u[n].  The sine vectors sin(pi i k/n)
+ * are the eigenvectors of this matrix with eigenvalues
+ * 4 sin^2(pi k/(2n)) / h^2, so two discrete sine transforms (DST-I) and
+ * a division solve it exactly in O(n log n).
+ *
+ * The transform is self-contained: a DST-I of length n is one complex
+ * FFT of length n/2 plus O(n) pre- and post-processing, and the FFT is
+ * a mixed-radix (4, 2, 3, 5) Stockham autosort FFT.  Long FFTs use the
+ * four-step algorithm, so every short FFT runs on a block that stays in
+ * cache; the loops over blocks and rows carry OpenMP pragmas (static
+ * schedule) and run sequentially without -fopenmp, as in multigrid.c.
+ */
+
+/* Whether n is handled: n even and n/2 a product of 2, 3 and 5 */
+int dst_supported(int n);
+
+/* --
+ * DST-I in place, x[k] = sum_{j=1}^{n-1} x[j] sin(pi j k/n) for
+ * k = 1 .. n-1 (x[0] is ignored).  Applying it twice multiplies by n/2.
+ * Returns 0, or -1 if n is not supported.
+ */
+int dst1(int n, double* x);
+
+/* --
+ * Exact solve, in place: reads u[0], u[n] and f, writes u[1 .. n-1].
+ * Returns 0, or -1 (u unchanged) if n is not supported.
+ */
+int dst_solve(int n, double* u, const double* f);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* DST_H_ */
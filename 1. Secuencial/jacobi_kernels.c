@@ -0,0 +1,635 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jacobi_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define HAVE_X86 1
+#  include <immintrin.h>
+#endif
+
+/* How far ahead (in doubles) the streaming kernels prefetch */
+#define PREFETCH_DIST 64
+
+/* Used when the LLC size cannot be queried */
+#define DEFAULT_LLC_SIZE (8L << 20)
+
+/* --
+ * Portable fallback, also the tail of the SSE2 kernels.  A separate
+ * multiply and add like SSE2; the AVX2/AVX-512 kernels use FMA, so their
+ * results can differ from these in the last bit.
+ */
+static void sweep_scalar(double* dst, const double* src,
+                         const double* f, double h2, int lo, int hi)
+{
+    int i;
+    double c = h2/2;
+    for (i = lo; i < hi; ++i)
+        dst[i] = (src[i-1] + src[i+1])*0.5 + c*f[i];
+}
+
+#ifdef HAVE_X86
+
+/* --
+ * SSE2 has no FMA, so the h2*f/2 term is a separate multiply-add.
+ */
+__attribute__((target("sse2")))
+static void sweep_sse2(double* dst, const double* src,
+                       const double* f, double h2, int lo, int hi)
+{
+    int i = lo;
+    __m128d half = _mm_set1_pd(0.5);
+    __m128d c    = _mm_set1_pd(h2/2);
+    for (; i + 2 <= hi; i += 2) {
+        __m128d s = _mm_add_pd(_mm_loadu_pd(src+i-1), _mm_loadu_pd(src+i+1));
+        __m128d r = _mm_add_pd(_mm_mul_pd(s, half),
+                               _mm_mul_pd(c, _mm_loadu_pd(f+i)));
+        _mm_storeu_pd(dst+i, r);
+    }
+    sweep_scalar(dst, src, f, h2, i, hi);
+}
+
+__attribute__((target("sse2")))
+static void sweep_sse2_nt(double* dst, const double* src,
+                          const double* f, double h2, int lo, int hi)
+{
+    int i = lo;
+    __m128d half = _mm_set1_pd(0.5);
+    __m128d c    = _mm_set1_pd(h2/2);
+
+    /* Peel until dst+i is 16-byte aligned for the streaming store */
+    while (i < hi && ((uintptr_t) (dst+i) & 15))
+        ++i;
+    sweep_scalar(dst, src, f, h2, lo, i);
+
+    for (; i + 2 <= hi; i += 2) {
+        _mm_prefetch((const char*) (src+i+PREFETCH_DIST), _MM_HINT_NTA);
+        _mm_prefetch((const char*) (f+i+PREFETCH_DIST), _MM_HINT_NTA);
+        __m128d s = _mm_add_pd(_mm_loadu_pd(src+i-1), _mm_loadu_pd(src+i+1));
+        __m128d r = _mm_add_pd(_mm_mul_pd(s, half),
+                               _mm_mul_pd(c, _mm_loadu_pd(f+i)));
+        _mm_stream_pd(dst+i, r);
+    }
+    _mm_sfence();
+    sweep_scalar(dst, src, f, h2, i, hi);
+}
+
+__attribute__((target("avx2,fma")))
+static void sweep_avx2(double* dst, const double* src,
+                       const double* f, double h2, int lo, int hi)
+{
+    int i = lo;
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d c    = _mm256_set1_pd(h2/2);
+    for (; i + 4 <= hi; i += 4) {
+        __m256d s = _mm256_add_pd(_mm256_loadu_pd(src+i-1),
+                                  _mm256_loadu_pd(src+i+1));
+        __m256d r = _mm256_fmadd_pd(c, _mm256_loadu_pd(f+i),
+                                    _mm256_mul_pd(s, half));
+        _mm256_storeu_pd(dst+i, r);
+    }
+    for (; i < hi; ++i)
+        dst[i] = __builtin_fma(c[0], f[i], (src[i-1] + src[i+1])*0.5);
+}
+
+__attribute__((target("avx2,fma")))
+static void sweep_avx2_nt(double* dst, const double* src,
+                          const double* f, double h2, int lo, int hi)
+{
+    int i = lo;
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d c    = _mm256_set1_pd(h2/2);
+
+    /* Peel until dst+i is 32-byte aligned for the streaming store */
+    for (; i < hi && ((uintptr_t) (dst+i) & 31); ++i)
+        dst[i] = __builtin_fma(c[0], f[i], (src[i-1] + src[i+1])*0.5);
+
+    for (; i + 4 <= hi; i += 4) {
+        _mm_prefetch((const char*) (src+i+PREFETCH_DIST), _MM_HINT_NTA);
+        _mm_prefetch((const char*) (f+i+PREFETCH_DIST), _MM_HINT_NTA);
+        __m256d s = _mm256_add_pd(_mm256_loadu_pd(src+i-1),
+                                  _mm256_loadu_pd(src+i+1));
+        __m256d r = _mm256_fmadd_pd(c, _mm256_loadu_pd(f+i),
+                                    _mm256_mul_pd(s, half));
+        _mm256_stream_pd(dst+i, r);
+    }
+    _mm_sfence();
+    for (; i < hi; ++i)
+        dst[i] = __builtin_fma(c[0], f[i], (src[i-1] + src[i+1])*0.5);
+}
+
+__attribute__((target("avx512f")))
+static void sweep_avx512(double* dst, const double* src,
+                         const double* f, double h2, int lo, int hi)
+{
+    int i = lo;
+    __m512d half = _mm512_set1_pd(0.5);
+    __m512d c    = _mm512_set1_pd(h2/2);
+    for (; i + 8 <= hi; i += 8) {
+        __m512d s = _mm512_add_pd(_mm512_loadu_pd(src+i-1),
+                                  _mm512_loadu_pd(src+i+1));
+        __m512d r = _mm512_fmadd_pd(c, _mm512_loadu_pd(f+i),
+                                    _mm512_mul_pd(s, half));
+        _mm512_storeu_pd(dst+i, r);
+    }
+    if (i < hi) {
+        /* Masked tail instead of a scalar loop */
+        __mmask8 m = (__mmask8) ((1u << (hi - i)) - 1);
+        __m512d s = _mm512_add_pd(_mm512_maskz_loadu_pd(m, src+i-1),
+                                  _mm512_maskz_loadu_pd(m, src+i+1));
+        __m512d r = _mm512_fmadd_pd(c, _mm512_maskz_loadu_pd(m, f+i),
+                                    _mm512_mul_pd(s, half));
+        _mm512_mask_storeu_pd(dst+i, m, r);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void sweep_avx512_nt(double* dst, const double* src,
+                            const double* f, double h2, int lo, int hi)
+{
+    int i = lo;
+    __m512d half = _mm512_set1_pd(0.5);
+    __m512d c    = _mm512_set1_pd(h2/2);
+    int head = (int) ((64 - ((uintptr_t) (dst+i) & 63)) & 63) / 8;
+
+    /* Peel until dst+i is 64-byte aligned for the streaming store */
+    if (head > hi - i)
+        head = hi - i;
+    sweep_avx512(dst, src, f, h2, i, i + head);
+    i += head;
+
+    for (; i + 8 <= hi; i += 8) {
+        _mm_prefetch((const char*) (src+i+PREFETCH_DIST), _MM_HINT_NTA);
+        _mm_prefetch((const char*) (f+i+PREFETCH_DIST), _MM_HINT_NTA);
+        __m512d s = _mm512_add_pd(_mm512_loadu_pd(src+i-1),
+                                  _mm512_loadu_pd(src+i+1));
+        __m512d r = _mm512_fmadd_pd(c, _mm512_loadu_pd(f+i),
+                                    _mm512_mul_pd(s, half));
+        _mm512_stream_pd(dst+i, r);
+    }
+    _mm_sfence();
+    sweep_avx512(dst, src, f, h2, i, hi);
+}
+
+#endif /* HAVE_X86 */
+
+
+/* --
+ * Fused two-sweep kernels.  STENCIL is the half-sweep update written
+ * exactly like the half-sweep kernel of the same family, so the fused
+ * result matches two split half-sweeps bit for bit.
+ */
+#define STENCIL_PLAIN(a, b, fi) (((a) + (b))*0.5 + c*(fi))
+#define STENCIL_FMA(a, b, fi)   __builtin_fma(c, (fi), ((a) + (b))*0.5)
+
+/* --
+ * Rolling-window form: old u at i, i+1 and t at i-1, i are carried in
+ * registers, so u[i] is overwritten as soon as u'[i] is known.  The
+ * last two points may need the right halo and are peeled off the loop.
+ * ACC(t, u) runs once per point with t[i] and the old u[i]; it is empty
+ * for the plain kernels and accumulates the residual otherwise.
+ */
+#define FUSED_ROLLING_BODY(STENCIL, ACC)                                    \
+    int i;                                                                  \
+    double c = h2/2;                                                        \
+    double ub, uc, ud, tl, tc, tr;                                          \
+                                                                            \
+    if (lo >= hi)                                                           \
+        return;                                                             \
+    ub = u[lo];                                                             \
+    uc = (lo+1 < hi) ? u[lo+1] : halo[2];                                   \
+    tl = (flags & JACOBI_LEFT_BC) ? halo[1] : STENCIL(halo[0], ub, f[lo-1]);\
+    tc = STENCIL(halo[1], uc, f[lo]);                                       \
+                                                                            \
+    for (i = lo; i < hi-2; ++i) {                                           \
+        ud = u[i+2];                                                        \
+        tr = STENCIL(ub, ud, f[i+1]);                                       \
+        ACC(tc, ub);                                                        \
+        u[i] = STENCIL(tl, tr, f[i]);                                       \
+        tl = tc; tc = tr; ub = uc; uc = ud;                                 \
+    }                                                                       \
+    for (; i < hi; ++i) {                                                   \
+        ud = halo[i+4-hi];                                                  \
+        tr = (i+1 == hi && (flags & JACOBI_RIGHT_BC)) ?                     \
+             halo[2] : STENCIL(ub, ud, f[i+1]);                             \
+        ACC(tc, ub);                                                        \
+        u[i] = STENCIL(tl, tr, f[i]);                                       \
+        tl = tc; tc = tr; ub = uc; uc = ud;                                 \
+    }
+
+#define NO_ACC(t, u)
+
+/* r = f + u'' = 2*(t - u)/h2, where t is the half-sweep update of u */
+#define RES_ACC(t, u)                                                       \
+    do {                                                                    \
+        double r = ((t) - (u)) * scale;                                     \
+        sumsq += r*r;                                                       \
+        if (fabs(r) > maxabs)                                               \
+            maxabs = fabs(r);                                               \
+    } while (0)
+
+#define DEFINE_FUSED_ROLLING(name, attr, STENCIL)                           \
+attr static void name(double* u, const double* f, double h2,                \
+                      int lo, int hi, const double halo[4], int flags)      \
+{                                                                           \
+    FUSED_ROLLING_BODY(STENCIL, NO_ACC)                                     \
+}
+
+#define DEFINE_FUSED_ROLLING_RES(name, attr, STENCIL)                       \
+attr static void name(double* u, const double* f, double h2,                \
+                      int lo, int hi, const double halo[4], int flags,      \
+                      double norms[2])                                      \
+{                                                                           \
+    double scale = 2/h2, sumsq = 0, maxabs = norms[1];                      \
+    do {                                                                    \
+        FUSED_ROLLING_BODY(STENCIL, RES_ACC)                                \
+    } while (0);                                                            \
+    norms[0] += sumsq;                                                      \
+    norms[1] = maxabs;                                                      \
+}
+
+/* Split half-sweep that also accumulates the residual of src */
+#define DEFINE_SWEEP_RES(name, attr, STENCIL)                               \
+attr static void name(double* dst, const double* src, const double* f,      \
+                      double h2, int lo, int hi, double norms[2])           \
+{                                                                           \
+    int i;                                                                  \
+    double c = h2/2;                                                        \
+    double scale = 2/h2, sumsq = 0, maxabs = norms[1];                      \
+    for (i = lo; i < hi; ++i) {                                             \
+        dst[i] = STENCIL(src[i-1], src[i+1], f[i]);                         \
+        RES_ACC(dst[i], src[i]);                                            \
+    }                                                                       \
+    norms[0] += sumsq;                                                      \
+    norms[1] = maxabs;                                                      \
+}
+
+DEFINE_FUSED_ROLLING(fused_scalar, , STENCIL_PLAIN)
+DEFINE_FUSED_ROLLING_RES(fused_res_plain, , STENCIL_PLAIN)
+DEFINE_SWEEP_RES(sweep_res_plain, , STENCIL_PLAIN)
+
+#ifdef HAVE_X86
+
+DEFINE_FUSED_ROLLING(fused_rolling_fma, __attribute__((target("fma"))),
+                     STENCIL_FMA)
+DEFINE_FUSED_ROLLING_RES(fused_res_fma, __attribute__((target("fma"))),
+                         STENCIL_FMA)
+DEFINE_SWEEP_RES(sweep_res_fma, __attribute__((target("fma"))), STENCIL_FMA)
+
+/* --
+ * Vector form.  Each block of W points recomputes t on both sides from
+ * unaligned loads of u at i-2, i and i+2; the result is stored one block
+ * late, after the next block has loaded the old values it overwrites.
+ * The first and last two points (plus the remainder) go through the
+ * rolling kernel with halos saved before the vector body runs.
+ */
+#define DEFINE_FUSED_VECTOR(name, attr, W, vec, LOADU, STOREU, SET1,        \
+                            ADD, MUL, MADD, rolling)                        \
+attr static void name(double* u, const double* f, double h2,                \
+                      int lo, int hi, const double halo[4], int flags)      \
+{                                                                           \
+    int i, b0 = lo + 2, b1;                                                 \
+    double head[4], tail[4];                                                \
+    vec half = SET1(0.5);                                                   \
+    vec c    = SET1(h2/2);                                                  \
+    vec tm, tp, um, u0, up, pending = SET1(0.0);                            \
+                                                                            \
+    if (hi - lo < 3*W) {                                                    \
+        rolling(u, f, h2, lo, hi, halo, flags);                             \
+        return;                                                             \
+    }                                                                       \
+    b1 = b0 + ((hi - 2 - b0) / W) * W;                                      \
+    head[0] = halo[0]; head[1] = halo[1]; head[2] = u[b0];   head[3] = u[b0+1];\
+    tail[0] = u[b1-2]; tail[1] = u[b1-1]; tail[2] = halo[2]; tail[3] = halo[3];\
+                                                                            \
+    for (i = b0; i < b1; i += W) {                                          \
+        um = LOADU(u+i-2);                                                  \
+        u0 = LOADU(u+i);                                                    \
+        up = LOADU(u+i+2);                                                  \
+        if (i > b0)                                                         \
+            STOREU(u+i-W, pending);                                         \
+        tm = MADD(c, LOADU(f+i-1), MUL(ADD(um, u0), half));                 \
+        tp = MADD(c, LOADU(f+i+1), MUL(ADD(u0, up), half));                 \
+        pending = MADD(c, LOADU(f+i), MUL(ADD(tm, tp), half));              \
+    }                                                                       \
+    STOREU(u+b1-W, pending);                                                \
+                                                                            \
+    rolling(u, f, h2, lo, b0, head, flags & JACOBI_LEFT_BC);                \
+    rolling(u, f, h2, b1, hi, tail, flags & JACOBI_RIGHT_BC);               \
+}
+
+#define SSE2_MADD(a, b, x) _mm_add_pd(_mm_mul_pd(a, b), x)
+DEFINE_FUSED_VECTOR(fused_sse2, __attribute__((target("sse2"))), 2, __m128d,
+                    _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd,
+                    _mm_add_pd, _mm_mul_pd, SSE2_MADD, fused_scalar)
+
+DEFINE_FUSED_VECTOR(fused_avx2, __attribute__((target("avx2,fma"))), 4,
+                    __m256d, _mm256_loadu_pd, _mm256_storeu_pd,
+                    _mm256_set1_pd, _mm256_add_pd, _mm256_mul_pd,
+                    _mm256_fmadd_pd, fused_rolling_fma)
+
+DEFINE_FUSED_VECTOR(fused_avx512, __attribute__((target("avx512f"))), 8,
+                    __m512d, _mm512_loadu_pd, _mm512_storeu_pd,
+                    _mm512_set1_pd, _mm512_add_pd, _mm512_mul_pd,
+                    _mm512_fmadd_pd, fused_rolling_fma)
+
+#endif /* HAVE_X86 */
+
+
+typedef struct {
+    const char* name;
+    jacobi_sweep_t cached;
+    jacobi_sweep_t streaming;
+    jacobi_fused_t fused;
+    jacobi_sweep_res_t sweep_res;
+    jacobi_fused_res_t fused_res;
+} kernel_entry_t;
+
+/* Ordered from most to least capable */
+static const kernel_entry_t kernels[] = {
+#ifdef HAVE_X86
+    { "avx512", sweep_avx512, sweep_avx512_nt, fused_avx512,
+      sweep_res_fma, fused_res_fma },
+    { "avx2",   sweep_avx2,   sweep_avx2_nt,   fused_avx2,
+      sweep_res_fma, fused_res_fma },
+    { "sse2",   sweep_sse2,   sweep_sse2_nt,   fused_sse2,
+      sweep_res_plain, fused_res_plain },
+#endif
+    { "scalar", sweep_scalar, sweep_scalar,    fused_scalar,
+      sweep_res_plain, fused_res_plain },
+};
+#define NKERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+static int cpu_supports(const char* name)
+{
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (strcmp(name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+static long llc_size(void)
+{
+    long size = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return (size > 0) ? size : DEFAULT_LLC_SIZE;
+}
+
+/* --
+ * Entry for this CPU, or the one named in JACOBI_KERNEL if the CPU
+ * supports it; *nt tells whether the -nt suffix was given.
+ */
+static const kernel_entry_t* select_kernels(int* nt)
+{
+    int k;
+    const char* env = getenv("JACOBI_KERNEL");
+
+    *nt = -1;
+    if (env != NULL) {
+        size_t len = strlen(env);
+        int suffix = (len > 3 && strcmp(env + len - 3, "-nt") == 0);
+        if (suffix)
+            len -= 3;
+        for (k = 0; k < NKERNELS; ++k)
+            if (strlen(kernels[k].name) == len &&
+                strncmp(env, kernels[k].name, len) == 0 &&
+                cpu_supports(kernels[k].name)) {
+                *nt = suffix;
+                return &kernels[k];
+            }
+    }
+
+    for (k = 0; k < NKERNELS; ++k)
+        if (cpu_supports(kernels[k].name))
+            return &kernels[k];
+    return &kernels[NKERNELS-1];
+}
+
+jacobi_sweep_t jacobi_kernel(long n)
+{
+    int nt;
+    const kernel_entry_t* k = select_kernels(&nt);
+
+    if (nt < 0)
+        nt = (3 * (n+1) * (long) sizeof(double) > llc_size());
+    return nt ? k->streaming : k->cached;
+}
+
+jacobi_fused_t jacobi_fused_kernel(void)
+{
+    int nt;
+    return select_kernels(&nt)->fused;
+}
+
+jacobi_sweep_res_t jacobi_sweep_res_kernel(void)
+{
+    int nt;
+    return select_kernels(&nt)->sweep_res;
+}
+
+jacobi_fused_res_t jacobi_fused_res_kernel(void)
+{
+    int nt;
+    return select_kernels(&nt)->fused_res;
+}
+
+int jacobi_halo(const double* u, int lo, int hi,
+                int left_bc, int right_bc, double halo[4])
+{
+    halo[0] = left_bc  ? 0.0 : u[lo-2];
+    halo[1] = u[lo-1];
+    halo[2] = u[hi];
+    halo[3] = right_bc ? 0.0 : u[hi+1];
+    return (left_bc ? JACOBI_LEFT_BC : 0) | (right_bc ? JACOBI_RIGHT_BC : 0);
+}
+
+int jacobi_use_fused(void)
+{
+    const char* env = getenv("JACOBI_FUSED");
+    return env == NULL || atoi(env) != 0;
+}
+
+const char* jacobi_kernel_name(jacobi_sweep_t sweep)
+{
+    int k;
+    for (k = 0; k < NKERNELS; ++k) {
+        if (sweep == kernels[k].cached)
+            return kernels[k].name;
+        if (sweep == kernels[k].streaming) {
+            static char buf[NKERNELS][16];
+            strcpy(buf[k], kernels[k].name);
+            strcat(buf[k], "-nt");
+            return buf[k];
+        }
+    }
+    return "unknown";
+}
+
+
+void jacobi_weighted_sweep(double* dst, const double* src, const double* f,
+                           double h2, double omega, int lo, int hi,
+                           double norms[2])
+{
+    int i;
+    double c = h2/2;
+    double scale = 2/h2, sumsq = 0, maxabs = 0;
+
+    if (norms == NULL) {
+        for (i = lo; i < hi; ++i) {
+            double t = (src[i-1] + src[i+1])*0.5 + c*f[i];
+            dst[i] = src[i] + omega*(t - src[i]);
+        }
+        return;
+    }
+    for (i = lo; i < hi; ++i) {
+        double t = (src[i-1] + src[i+1])*0.5 + c*f[i];
+        double r = (t - src[i]) * scale;
+        dst[i] = src[i] + omega*(t - src[i]);
+        sumsq += r*r;
+        if (fabs(r) > maxabs)
+            maxabs = fabs(r);
+    }
+    norms[0] += sumsq;
+    if (maxabs > norms[1])
+        norms[1] = maxabs;
+}
+
+void jacobi_chebyshev_sweep(double* dst, const double* src, const double* f,
+                            double h2, double omega, int lo, int hi,
+                            double norms[2])
+{
+    int i;
+    double c = h2/2;
+    double scale = 2/h2, sumsq = 0, maxabs = 0;
+    /* The first sweep (omega = 1) has no previous iterate */
+    const double* prev = (omega == 1) ? src : dst;
+
+    if (norms == NULL) {
+        for (i = lo; i < hi; ++i) {
+            double t = (src[i-1] + src[i+1])*0.5 + c*f[i];
+            dst[i] = prev[i] + omega*(t - prev[i]);
+        }
+        return;
+    }
+    for (i = lo; i < hi; ++i) {
+        double t = (src[i-1] + src[i+1])*0.5 + c*f[i];
+        double r = (t - src[i]) * scale;
+        dst[i] = prev[i] + omega*(t - prev[i]);
+        sumsq += r*r;
+        if (fabs(r) > maxabs)
+            maxabs = fabs(r);
+    }
+    norms[0] += sumsq;
+    if (maxabs > norms[1])
+        norms[1] = maxabs;
+}
+
+void jacobi_rb_sweep(double* u, const double* f, double h2, double omega,
+                     int lo, int hi, int color)
+{
+    int i;
+    double c = h2/2;
+
+    for (i = lo + ((lo ^ color) & 1); i < hi; i += 2) {
+        double t = (u[i-1] + u[i+1])*0.5 + c*f[i];
+        u[i] += omega*(t - u[i]);
+    }
+}
+
+void jacobi_residual(const double* u, const double* f, double h2,
+                     int lo, int hi, double norms[2])
+{
+    int i;
+    double sumsq = 0, maxabs = 0;
+
+    for (i = lo; i < hi; ++i) {
+        double r = f[i] + (u[i-1] - 2*u[i] + u[i+1]) / h2;
+        sumsq += r*r;
+        if (fabs(r) > maxabs)
+            maxabs = fabs(r);
+    }
+    norms[0] += sumsq;
+    if (maxabs > norms[1])
+        norms[1] = maxabs;
+}
+
+void jacobi_cg_init(double* r, double* z, const double* u, const double* f,
+                    double h2, double dinv, int lo, int hi)
+{
+    int i;
+
+    for (i = lo; i < hi; ++i) {
+        r[i] = h2*f[i] - (2*u[i] - u[i-1] - u[i+1]);
+        z[i] = dinv * r[i];
+    }
+}
+
+void jacobi_cg_apply(double* w, const double* z, const double* r,
+                     double h2, int lo, int hi, double dots[4])
+{
+    int i;
+    double scale = 1/h2, sumsq = 0, maxabs = 0, rz = 0, wz = 0;
+
+    for (i = lo; i < hi; ++i) {
+        double ri = r[i] * scale;
+        w[i] = 2*z[i] - z[i-1] - z[i+1];
+        rz += r[i] * z[i];
+        wz += w[i] * z[i];
+        sumsq += ri*ri;
+        if (fabs(ri) > maxabs)
+            maxabs = fabs(ri);
+    }
+    dots[0] += sumsq;
+    if (maxabs > dots[1])
+        dots[1] = maxabs;
+    dots[2] += rz;
+    dots[3] += wz;
+}
+
+void jacobi_cg_update(double* u, double* r, double* z, double* p, double* s,
+                      const double* w, double alpha, double beta,
+                      double dinv, int lo, int hi)
+{
+    int i;
+
+    for (i = lo; i < hi; ++i) {
+        double pi = z[i] + beta*p[i];
+        double si = w[i] + beta*s[i];
+        p[i] = pi;
+        s[i] = si;
+        u[i] += alpha*pi;
+        r[i] -= alpha*si;
+        z[i] = dinv * r[i];
+    }
+}
+
+void jacobi_cg_step(const double dots[4], double* gamma, double* alpha,
+                    double* beta)
+{
+    double g = dots[2];
+
+    if (g == 0) {
+        /* Exact solution: nothing left to do */
+        *alpha = *beta = 0;
+    } else if (*gamma == 0) {
+        *beta  = 0;
+        *alpha = g / dots[3];
+    } else {
+        *beta  = g / *gamma;
+        *alpha = g / (dots[3] - *beta * g / *alpha);
+    }
+    *gamma = g;
+}
@@ -0,0 +1,129 @@
+#ifndef JACOBI_OPTS_H_
+#define JACOBI_OPTS_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * Residual-based termination, shared by every driver:
+ *
+ *    --tol X    stop once the discrete residual ||f + u''||_2 <= X
+ *    --check K  measure the residual every K sweeps (rounded up to even)
+ *
+ * With neither option the drivers run exactly nsteps sweeps as before;
+ * with --tol, nsteps becomes the maximum number of sweeps.  The residual
+ * is accumulated by the *_res kernels during a regular sweep, so a check
+ * costs no extra pass over memory.
+ */
+typedef struct {
+    double tol;     /* 0 = no early stop */
+    int check;      /* sweeps between checks, 0 = never check */
+    int solver;     /* JACOBI_SOLVER_*, from --solver NAME */
+    double omega;   /* --omega W, 0 = default of the solver */
+    int error;      /* --error: report the max error against the direct solve */
+} jacobi_opts_t;
+
+/* --
+ * Solver selected with --solver NAME (default jacobi).  Not every driver
+ * implements every solver; see jacobi_require_solvers().
+ *
+ *    jacobi   plain Jacobi sweeps (the original method)
+ *    vcycle   multigrid V-cycles with damped Jacobi smoothing
+ *    fmg      one full multigrid pass, then V-cycles
+ *    wjacobi  damped Jacobi, u += omega*(t - u)  (omega = 2/3 by default)
+ *    rbgs     red-black Gauss-Seidel
+ *    sor      red-black SOR, omega = 2/(1 + sin(pi/n)) by default
+ *    chebyshev Jacobi with Chebyshev acceleration, weights from n
+ *    direct   exact tridiagonal solve (Thomas, or partitioned in parallel)
+ *    fft      exact solve by two fast sine transforms (see dst.h)
+ *    cg       conjugate gradients, O(n) iterations (see jacobi_kernels.h)
+ *    pcg      cg with the Jacobi (diagonal) preconditioner
+ */
+enum {
+    JACOBI_SOLVER_JACOBI,
+    JACOBI_SOLVER_VCYCLE,
+    JACOBI_SOLVER_FMG,
+    JACOBI_SOLVER_WJACOBI,
+    JACOBI_SOLVER_RBGS,
+    JACOBI_SOLVER_SOR,
+    JACOBI_SOLVER_CHEBYSHEV,
+    JACOBI_SOLVER_DIRECT,
+    JACOBI_SOLVER_FFT,
+    JACOBI_SOLVER_CG,
+    JACOBI_SOLVER_PCG,
+    JACOBI_NUM_SOLVERS
+};
+
+#define JACOBI_SOLVER_MASK(s) (1u << (s))
+
+typedef struct {
+    int sweeps;     /* sweeps actually done */
+    int checked;    /* sweep at which the residual below was measured */
+    double res_l2;  /* sqrt(h * sum r^2) */
+    double res_linf;
+} jacobi_stats_t;
+
+/* Sweeps between checks when only --tol is given */
+#define JACOBI_DEFAULT_CHECK 100
+
+/* --
+ * Take --tol, --check, --solver, --omega and --error out of argv
+ * (updating *argc) so the remaining positional arguments are parsed as
+ * before.
+ */
+void jacobi_parse_opts(int* argc, char** argv, jacobi_opts_t* opts);
+
+/* Name of a solver, as accepted by --solver */
+const char* jacobi_solver_name(int solver);
+
+/* --
+ * Relaxation weight for the solver: --omega if given, else 2/3 for
+ * wjacobi, the optimal 2/(1 + sin(pi h)) for sor (which takes SOR from
+ * O(n^2) to O(n) sweeps on the 1D Laplacian) and 1 otherwise.
+ */
+double jacobi_omega(const jacobi_opts_t* opts, int n);
+
+/* --
+ * Weight of Chebyshev sweep number sweep (0, 1, ...) for n intervals,
+ * given prev, the weight of the sweep before.  The Jacobi eigenvalues of
+ * the 1D Laplacian lie in [-rho, rho] with rho = cos(pi/n), which gives
+ *
+ *    omega_0 = 1,  omega_1 = 1/(1 - rho^2/2),
+ *    omega_k = 1/(1 - rho^2 omega_{k-1}/4)
+ *
+ * and a convergence rate like that of optimal SOR, in O(n) sweeps.
+ */
+double jacobi_chebyshev_omega(int n, int sweep, double prev);
+
+/* --
+ * Exit with a message unless opts->solver is in mask, a combination of
+ * JACOBI_SOLVER_MASK() bits for the solvers a driver implements.
+ */
+void jacobi_require_solvers(const jacobi_opts_t* opts, unsigned mask);
+
+/* Whether the sweep pair starting at sweep should measure the residual */
+int jacobi_check_due(const jacobi_opts_t* opts, int sweep);
+
+/* --
+ * Record the global norms[] = { sum r^2, max |r| } measured at sweep in
+ * stats and return nonzero when the tolerance is met.
+ */
+int jacobi_converged(const jacobi_opts_t* opts, jacobi_stats_t* stats,
+                     int sweep, const double norms[2], double h);
+
+/* --
+ * Combine per-thread partials (two doubles per part, laid out like
+ * norms[]) in a fixed order, so every thread gets the same total.
+ */
+void jacobi_sum_norms(const double* partials, int nparts, double norms[2]);
+
+/* Print iterations and final residual when residual checks were on */
+void jacobi_print_stats(const jacobi_opts_t* opts,
+                        const jacobi_stats_t* stats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* JACOBI_OPTS_H_ */
@@ -3,6 +3,11 @@
 #include <string.h>
 
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "multigrid.h"
+#include "tridiag.h"
+#include "dst.h"
 
 /* --
  * Do nsweeps sweeps of Jacobi iteration on a 1D Poisson problem
@@ -12,28 +17,313 @@
  * discretized by n+1 equally spaced mesh points on [0,1].
  * u is subject to Dirichlet boundary conditions specified in
  * the u[0] and u[n] entries of the initial vector.
+ *
+ * Sweeps are done two at a time by the fused kernel, in place in u
+ * (JACOBI_FUSED=0 switches back to the split utmp/u loop).  An odd
+ * nsweeps ends with one half-sweep into utmp copied back to u, as in
+ * the threaded version.
+ *
+ * When opts asks for residual checks, every opts->check sweeps the pair
+ * is done by the residual kernel instead, and the loop stops early once
+ * the tolerance is met.  stats gets the sweeps done and last residual.
  */
+void jacobi_tol(int nsweeps, int n, double* u, double* f,
+                const jacobi_opts_t* opts, jacobi_stats_t* stats)
+{
+    int sweep, done = 0;
+    double h  = 1.0 / n;
+    double h2 = h*h;
+    double norms[2];
+    double* utmp = NULL;
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
+    int fused = jacobi_use_fused();
+
+    if (!fused || nsweeps % 2 != 0) {
+        utmp = (double*) malloc( (n+1) * sizeof(double) );
+
+        /* Fill boundary conditions into utmp */
+        utmp[0] = u[0];
+        utmp[n] = u[n];
+    }
+
+    if (fused) {
+        jacobi_fused_t fused_sweep = jacobi_fused_kernel();
+        jacobi_fused_res_t fused_res = jacobi_fused_res_kernel();
+        double halo[4];
+        int flags = jacobi_halo(u, 1, n, 1, 1, halo);
+
+        /* Old data in u; data two sweeps later in u */
+        for (sweep = 0; sweep < nsweeps - 1 && !done; sweep += 2) {
+            if (jacobi_check_due(opts, sweep)) {
+                norms[0] = norms[1] = 0;
+                fused_res(u, f, h2, 1, n, halo, flags, norms);
+                done = jacobi_converged(opts, stats, sweep, norms, h);
+            } else {
+                fused_sweep(u, f, h2, 1, n, halo, flags);
+            }
+        }
+    } else {
+        jacobi_sweep_res_t sweep_res = jacobi_sweep_res_kernel();
+
+        for (sweep = 0; sweep < nsweeps - 1 && !done; sweep += 2) {
+            
+            /* Old data in u; new data in utmp */
+            if (jacobi_check_due(opts, sweep)) {
+                norms[0] = norms[1] = 0;
+                sweep_res(utmp, u, f, h2, 1, n, norms);
+                done = jacobi_converged(opts, stats, sweep, norms, h);
+            } else {
+                half_sweep(utmp, u, f, h2, 1, n);
+            }
+            
+            /* Old data in utmp; new data in u */
+            half_sweep(u, utmp, f, h2, 1, n);
+        }
+    }
+
+    /* If nsweeps is odd, do one extra half-sweep */
+    if (nsweeps % 2 != 0 && !done) {
+        half_sweep(utmp, u, f, h2, 1, n);
+        memcpy(u+1, utmp+1, (n-1) * sizeof(double));
+        ++sweep;
+    }
+    if (stats)
+        stats->sweeps = sweep;
+
+    free(utmp);
+}
+
 void jacobi(int nsweeps, int n, double* u, double* f)
 {
-    int i, sweep;
+    jacobi_tol(nsweeps, n, u, f, NULL, NULL);
+}
+
+
+/* --
+ * The same loop for the other relaxation schemes of opts->solver:
+ * damped and Chebyshev-accelerated Jacobi alternate between u and utmp
+ * like the split loop (Chebyshev keeps the previous iterate in the array
+ * it overwrites), while red-black Gauss-Seidel and SOR update u in
+ * place, one color at a time.
+ * Checked pairs measure the residual of u before the pair, as the
+ * Jacobi kernels do.
+ */
+void relax_tol(int nsweeps, int n, double* u, double* f,
+               const jacobi_opts_t* opts, jacobi_stats_t* stats)
+{
+    int sweep, color, check, done = 0;
     double h  = 1.0 / n;
     double h2 = h*h;
+    double omega = jacobi_omega(opts, n);
+    double norms[2];
+    double* utmp = NULL;
+    int red_black = (opts->solver == JACOBI_SOLVER_RBGS ||
+                     opts->solver == JACOBI_SOLVER_SOR);
+    int chebyshev = (opts->solver == JACOBI_SOLVER_CHEBYSHEV);
+
+    if (!red_black) {
+        utmp = (double*) malloc( (n+1) * sizeof(double) );
+        utmp[0] = u[0];
+        utmp[n] = u[n];
+    }
+
+    for (sweep = 0; sweep < nsweeps - 1 && !done; sweep += 2) {
+        check = jacobi_check_due(opts, sweep);
+        if (check)
+            norms[0] = norms[1] = 0;
+
+        if (red_black) {
+            if (check)
+                jacobi_residual(u, f, h2, 1, n, norms);
+            for (color = 0; color < 4; ++color)
+                jacobi_rb_sweep(u, f, h2, omega, 1, n, color & 1);
+        } else if (chebyshev) {
+            omega = jacobi_chebyshev_omega(n, sweep, omega);
+            jacobi_chebyshev_sweep(utmp, u, f, h2, omega, 1, n,
+                                   check ? norms : NULL);
+            omega = jacobi_chebyshev_omega(n, sweep + 1, omega);
+            jacobi_chebyshev_sweep(u, utmp, f, h2, omega, 1, n, NULL);
+        } else {
+            jacobi_weighted_sweep(utmp, u, f, h2, omega, 1, n,
+                                  check ? norms : NULL);
+            jacobi_weighted_sweep(u, utmp, f, h2, omega, 1, n, NULL);
+        }
+
+        if (check)
+            done = jacobi_converged(opts, stats, sweep, norms, h);
+    }
+
+    /* If nsweeps is odd, do one extra sweep */
+    if (nsweeps % 2 != 0 && !done) {
+        if (red_black) {
+            jacobi_rb_sweep(u, f, h2, omega, 1, n, 0);
+            jacobi_rb_sweep(u, f, h2, omega, 1, n, 1);
+        } else {
+            if (chebyshev) {
+                omega = jacobi_chebyshev_omega(n, sweep, omega);
+                jacobi_chebyshev_sweep(utmp, u, f, h2, omega, 1, n, NULL);
+            } else {
+                jacobi_weighted_sweep(utmp, u, f, h2, omega, 1, n, NULL);
+            }
+            memcpy(u+1, utmp+1, (n-1) * sizeof(double));
+        }
+        ++sweep;
+    }
+    if (stats)
+        stats->sweeps = sweep;
+
+    free(utmp);
+}
+
+
+/* --
+ * Conjugate gradients (--solver cg / pcg), at most niters iterations.
+ * Every iteration is one fused update pass and one stencil pass that
+ * also yields the inner products and the residual norms, so a check
+ * costs nothing extra; the recursive residual is what gets measured.
+ */
+void jacobi_cg(int niters, int n, double* u, double* f,
+               const jacobi_opts_t* opts, jacobi_stats_t* stats)
+{
+    int it, done = 0;
+    double h  = 1.0 / n;
+    double h2 = h*h;
+    double dinv = (opts->solver == JACOBI_SOLVER_PCG) ? 0.5 : 1.0;
+    double gamma = 0, alpha = 0, beta = 0;
+    double dots[4] = { 0, 0, 0, 0 };
+    double* r = (double*) calloc(n+1, sizeof(double));
+    double* w = (double*) calloc(n+1, sizeof(double));
+    double* p = (double*) calloc(n+1, sizeof(double));
+    double* s = (double*) calloc(n+1, sizeof(double));
+    double* z = (dinv != 1) ? (double*) calloc(n+1, sizeof(double)) : r;
+
+    jacobi_cg_init(r, z, u, f, h2, dinv, 1, n);
+    jacobi_cg_apply(w, z, r, h2, 1, n, dots);
+    jacobi_cg_step(dots, &gamma, &alpha, &beta);
+
+    for (it = 0; it < niters && !done; ++it) {
+        jacobi_cg_update(u, r, z, p, s, w, alpha, beta, dinv, 1, n);
+        dots[0] = dots[1] = dots[2] = dots[3] = 0;
+        jacobi_cg_apply(w, z, r, h2, 1, n, dots);
+        if (jacobi_check_due(opts, it+1))
+            done = jacobi_converged(opts, stats, it+1, dots, h);
+        jacobi_cg_step(dots, &gamma, &alpha, &beta);
+    }
+    stats->sweeps = it;
+
+    if (z != r)
+        free(z);
+    free(s);
+    free(p);
+    free(w);
+    free(r);
+}
+
+
+/* Exact solve with the Thomas algorithm (--solver direct) */
+void jacobi_direct(int n, double* u, double* f)
+{
+    double* work = (double*) malloc( (n+1) * sizeof(double) );
+
+    tridiag_solve(n, u, f, work);
+    free(work);
+}
+
+
+/* --
+ * Exact solve by fast sine transforms (--solver fft).  Sizes the FFT
+ * does not handle fall back to jacobi_direct().
+ */
+void jacobi_fft(int n, double* u, double* f)
+{
+    if (dst_solve(n, u, f) < 0) {
+        fprintf(stderr, "fft: n/2 = %d is not a product of 2, 3 and 5; "
+                "using the direct solver\n", n/2);
+        jacobi_direct(n, u, f);
+    }
+}
+
+
+/* Trapezoids narrower than this are swept row by row */
+#define WALK_MIN_WIDTH 512
+
+/* --
+ * Space-time context shared by the trapezoid walk.  Level t of the
+ * iteration lives in buf[t & 1], so buf[0] = u and buf[1] = utmp.
+ */
+typedef struct {
+    double* buf[2];
+    double* f;
+    double h2;
+    jacobi_sweep_t half_sweep;
+} stencil_t;
+
+/* --
+ * Cache-oblivious trapezoid walk (Frigo & Strumpen) over the region
+ *
+ *    t0 <= t < t1,   x0 + dx0*(t-t0) <= x < x1 + dx1*(t-t0)
+ *
+ * of the space-time domain.  Wide trapezoids are cut in space along a
+ * line of slope -1, tall ones are cut in time, so every piece small
+ * enough to fit in some level of cache advances several sweeps before
+ * it is evicted.  Each point is computed from exactly the same inputs
+ * as in the plain double-buffer loop, so results are bit-identical.
+ */
+static void walk(stencil_t* s, int t0, int t1,
+                 int x0, int dx0, int x1, int dx1)
+{
+    int t, dt = t1 - t0;
+
+    if (dt == 1 || x1 - x0 < WALK_MIN_WIDTH) {
+        /* Small trapezoid: its rows are a valid schedule by themselves */
+        for (t = t0; t < t1; ++t, x0 += dx0, x1 += dx1)
+            if (x0 < x1)
+                s->half_sweep(s->buf[(t + 1) & 1], s->buf[t & 1],
+                              s->f, s->h2, x0, x1);
+    } else if (2*(x1-x0) + (dx1-dx0)*dt >= 4*dt) {
+        /* Space cut */
+        int xm = (2*(x0+x1) + (2+dx0+dx1)*dt) / 4;
+        walk(s, t0, t1, x0, dx0, xm, -1);
+        walk(s, t0, t1, xm, -1, x1, dx1);
+    } else {
+        /* Time cut */
+        int h = dt / 2;
+        walk(s, t0, t0+h, x0, dx0, x1, dx1);
+        walk(s, t0+h, t1, x0 + dx0*h, dx0, x1 + dx1*h, dx1);
+    }
+}
+
+/* --
+ * Temporally blocked variant of jacobi().  The sweeps are advanced in
+ * time blocks of at most depth steps; within a block the trapezoid walk
+ * keeps the working set in cache instead of streaming u, utmp and f
+ * through memory once per half-sweep.  Produces the same u as the
+ * split loop of jacobi(), bit for bit.
+ */
+void jacobi_blocked(int nsweeps, int n, double* u, double* f, int depth)
+{
+    int t, nt;
+    double h = 1.0 / n;
+    stencil_t s;
     double* utmp = (double*) malloc( (n+1) * sizeof(double) );
 
     /* Fill boundary conditions into utmp */
     utmp[0] = u[0];
     utmp[n] = u[n];
 
-    for (sweep = 0; sweep < nsweeps; sweep += 2) {
-        
-        /* Old data in u; new data in utmp */
-        for (i = 1; i < n; ++i)
-            utmp[i] = (u[i-1] + u[i+1] + h2*f[i])/2;
-        
-        /* Old data in utmp; new data in u */
-        for (i = 1; i < n; ++i)
-            u[i] = (utmp[i-1] + utmp[i+1] + h2*f[i])/2;
-    }
+    s.buf[0] = u;
+    s.buf[1] = utmp;
+    s.f      = f;
+    s.h2     = h*h;
+    s.half_sweep = jacobi_kernel(0);
+
+    nt = nsweeps;
+    for (t = 0; t < nt; t += depth)
+        walk(&s, t, (t + depth < nt) ? t + depth : nt, 1, 0, n, 0);
+
+    /* An odd number of sweeps leaves the last level in utmp */
+    if (nt % 2 != 0)
+        memcpy(u+1, utmp+1, (n-1) * sizeof(double));
 
     free(utmp);
 }
@@ -53,19 +343,41 @@ void write_solution(int n, double* u, const char* fname)
 int main(int argc, char** argv)
 {
     int i;
-    int n, nsteps;
+    int n, nsteps, depth;
     double* u;
     double* f;
     double h;
     timing_t tstart, tend;
     char* fname;
+    jacobi_opts_t opts;
+    jacobi_stats_t stats = { 0, 0, 0, 0 };
 
     /* Process arguments */
+    jacobi_parse_opts(&argc, argv, &opts);
     n      = (argc > 1) ? atoi(argv[1]) : 100;
     nsteps = (argc > 2) ? atoi(argv[2]) : 100;
     fname  = (argc > 3) ? argv[3] : NULL;
+    depth  = (argc > 4) ? atoi(argv[4]) : 0;
     h      = 1.0/n;
 
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_VCYCLE) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_FMG) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_WJACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_RBGS) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_SOR) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CHEBYSHEV) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_DIRECT) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_FFT) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CG) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_PCG));
+
+    /* Residual checks and the other solvers need the plain sweep loop */
+    if ((opts.check > 0 || opts.solver != JACOBI_SOLVER_JACOBI) && depth > 0) {
+        fprintf(stderr, "--tol/--check/--solver ignore tile_depth\n");
+        depth = 0;
+    }
+
     /* Allocate and initialize arrays */
     u = (double*) malloc( (n+1) * sizeof(double) );
     f = (double*) malloc( (n+1) * sizeof(double) );
@@ -75,14 +387,40 @@ int main(int argc, char** argv)
 
     /* Run the solver */
     get_time(&tstart);
-    jacobi(nsteps, n, u, f);
+    if (opts.solver == JACOBI_SOLVER_VCYCLE || opts.solver == JACOBI_SOLVER_FMG)
+        /* nsteps counts V-cycles here */
+        mg_solve(n, u, f, opts.solver == JACOBI_SOLVER_FMG, nsteps,
+                 &opts, &stats);
+    else if (opts.solver == JACOBI_SOLVER_DIRECT)
+        jacobi_direct(n, u, f);
+    else if (opts.solver == JACOBI_SOLVER_FFT)
+        jacobi_fft(n, u, f);
+    else if (opts.solver == JACOBI_SOLVER_CG || opts.solver == JACOBI_SOLVER_PCG)
+        /* nsteps counts CG iterations here */
+        jacobi_cg(nsteps, n, u, f, &opts, &stats);
+    else if (opts.solver != JACOBI_SOLVER_JACOBI)
+        relax_tol(nsteps, n, u, f, &opts, &stats);
+    else if (depth > 0)
+        jacobi_blocked(nsteps, n, u, f, depth);
+    else
+        jacobi_tol(nsteps, n, u, f, &opts, &stats);
     get_time(&tend);
 
     /* Run the solver */    
     printf("n: %d\n"
            "nsteps: %d\n"
+           "solver: %s\n"
+           "tile depth: %d\n"
+           "sweep: %s\n"
+           "kernel: %s\n"
            "Elapsed time: %g s\n", 
-           n, nsteps, timespec_diff(tstart, tend));
+           n, nsteps, jacobi_solver_name(opts.solver), depth,
+           (depth == 0 && jacobi_use_fused()) ? "fused" : "split",
+           jacobi_kernel_name(depth > 0 ? jacobi_kernel(0) : jacobi_kernel(n)),
+           timespec_diff(tstart, tend));
+    jacobi_print_stats(&opts, &stats);
+    if (opts.error)
+        printf("error vs direct: %g\n", tridiag_error(n, u, f));
 
     /* Write the results */
     if (fname)
@@ -15,7 +15,7 @@ NSTEPS_VALUES=(100 500 1000 2000 5000)
 NUM_THREADS=12
 
 # Compilar el programa
-gcc -DUSE_CLOCK -O3 threads4-jacobi1d.c timing.c -pthread -march=native -funroll-loops -o jacobi1d
+gcc -DUSE_CLOCK -O3 threads4-jacobi1d.c timing.c jacobi_kernels.c jacobi_opts.c tridiag.c jacobi_sync.c jacobi_numa.c jacobi_topo.c jacobi_part.c -pthread -funroll-loops -o jacobi1d -lm
 
 # Ejecutar benchmarks
 for N in "${N_VALUES[@]}"; do
@@ -0,0 +1,166 @@
+#ifndef JACOBI_KERNELS_H_
+#define JACOBI_KERNELS_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * One Jacobi half-sweep over the index range [lo, hi):
+ *
+ *    dst[i] = (src[i-1] + src[i+1])/2 + (h2/2)*f[i]
+ *
+ * Reads src[lo-1] .. src[hi], writes dst[lo] .. dst[hi-1] only, so
+ * callers can split [1, n) among threads or processes freely.
+ */
+typedef void (*jacobi_sweep_t)(double* dst, const double* src,
+                               const double* f, double h2, int lo, int hi);
+
+/* --
+ * Return the fastest half-sweep kernel for this CPU (chosen by CPUID
+ * at runtime) and for arrays of n+1 points.  When the three arrays do
+ * not fit in the last level cache the streaming variant (non-temporal
+ * stores plus software prefetch) is returned; pass n = 0 to always get
+ * the cached variant.  The JACOBI_KERNEL environment variable
+ * (scalar, sse2, avx2, avx512, optionally suffixed with -nt) overrides
+ * the choice.
+ */
+jacobi_sweep_t jacobi_kernel(long n);
+
+/* Human readable name of a kernel returned by jacobi_kernel() */
+const char* jacobi_kernel_name(jacobi_sweep_t k);
+
+/* --
+ * Two Jacobi sweeps fused into one pass, computing u^{k+2} from u^k in
+ * place over [lo, hi) with the 5-point effective stencil
+ *
+ *    t[j]  = (u[j-1] + u[j+1])/2 + (h2/2)*f[j]
+ *    u'[i] = (t[i-1] + t[i+1])/2 + (h2/2)*f[i]
+ *
+ * The intermediate t values live in registers, so utmp is never
+ * written.  Values of u^k outside [lo, hi) are taken from halo[] =
+ * { u[lo-2], u[lo-1], u[hi], u[hi+1] }, never from u itself, so
+ * neighbouring chunks may be updated concurrently once every chunk
+ * has saved its halo.  JACOBI_LEFT_BC / JACOBI_RIGHT_BC mark u[lo-1]
+ * or u[hi] as a Dirichlet value, which t keeps unchanged there (the
+ * same thing utmp[0] = u[0] and utmp[n] = u[n] do for the split loop).
+ * Results are bit-identical to two calls of the matching half-sweep.
+ */
+#define JACOBI_LEFT_BC  1
+#define JACOBI_RIGHT_BC 2
+
+typedef void (*jacobi_fused_t)(double* u, const double* f, double h2,
+                               int lo, int hi, const double halo[4],
+                               int flags);
+
+/* Fused kernel for this CPU; JACOBI_KERNEL is honoured as above */
+jacobi_fused_t jacobi_fused_kernel(void);
+
+/* --
+ * Variants of the two kernels above that also accumulate the discrete
+ * residual r = f + u'' of the input level over [lo, hi):
+ *
+ *    norms[0] += sum r[i]^2,   norms[1] = max(norms[1], |r[i]|)
+ *
+ * The residual falls out of the update (r[i] = 2*(t[i] - u[i])/h2 with
+ * t the half-sweep of u), so a convergence check costs no extra pass
+ * over memory.  Rounding of the update matches the kernels for this CPU.
+ */
+typedef void (*jacobi_sweep_res_t)(double* dst, const double* src,
+                                   const double* f, double h2,
+                                   int lo, int hi, double norms[2]);
+typedef void (*jacobi_fused_res_t)(double* u, const double* f, double h2,
+                                   int lo, int hi, const double halo[4],
+                                   int flags, double norms[2]);
+
+jacobi_sweep_res_t jacobi_sweep_res_kernel(void);
+jacobi_fused_res_t jacobi_fused_res_kernel(void);
+
+/* --
+ * Save the halo of [lo, hi) from u into halo[] and return the flags for
+ * the fused kernel.  left_bc / right_bc say whether lo-1 / hi are the
+ * global boundary points.
+ */
+int jacobi_halo(const double* u, int lo, int hi,
+                int left_bc, int right_bc, double halo[4]);
+
+/* --
+ * Update rules other than plain Jacobi (portable C, left to the compiler
+ * to vectorize).  With t[i] the plain Jacobi value of point i:
+ *
+ * jacobi_weighted_sweep: dst[i] = src[i] + omega*(t[i] - src[i]) over
+ *   [lo, hi), i.e. damped Jacobi; norms (may be NULL) accumulates the
+ *   residual of src like the *_res kernels.
+ *
+ * jacobi_rb_sweep: the same update in place, only for the points of one
+ *   color (i % 2 == color) in [lo, hi).  A red then a black call is one
+ *   Gauss-Seidel (omega = 1) or SOR sweep in red-black order; points of
+ *   one color only read the other color, so chunks of [1, n) can be
+ *   relaxed concurrently with a barrier between colors.
+ *
+ * jacobi_chebyshev_sweep: dst[i] += omega*(t[i] - dst[i]), where src
+ *   holds iterate k and dst iterate k-1 on entry and iterate k+1 on exit,
+ *   so Chebyshev semi-iteration needs no array beyond the usual utmp.
+ *   omega = 1 (the first sweep) ignores dst.  norms as above.
+ *
+ * jacobi_residual: accumulate the residual of u over [lo, hi) into norms
+ *   without writing anything, for the in-place schemes.
+ */
+void jacobi_weighted_sweep(double* dst, const double* src, const double* f,
+                           double h2, double omega, int lo, int hi,
+                           double norms[2]);
+void jacobi_chebyshev_sweep(double* dst, const double* src, const double* f,
+                            double h2, double omega, int lo, int hi,
+                            double norms[2]);
+void jacobi_rb_sweep(double* u, const double* f, double h2, double omega,
+                     int lo, int hi, int color);
+void jacobi_residual(const double* u, const double* f, double h2,
+                     int lo, int hi, double norms[2]);
+
+/* --
+ * Conjugate gradients (--solver cg / pcg) on A u = h2 f, where
+ * A = tridiag(-1, 2, -1) is the stencil of the sweeps times h^2, applied
+ * matrix free.  The iteration is the Chronopoulos-Gear form of CG, in
+ * which both inner products of an iteration come out of the same pass,
+ * so a parallel run needs one halo exchange of z and one reduction of
+ * dots[] per iteration.  Arrays are n+1 long; z, p and s start at zero,
+ * z[0], z[n] and the other boundary entries stay zero.  dinv is the
+ * inverse diagonal of the preconditioner: 1 with z = r (plain CG, z may
+ * alias r) or 1/2 with a separate z for Jacobi preconditioning.
+ *
+ * jacobi_cg_init: r = h2 f - A u and z = dinv r over [lo, hi).
+ *
+ * jacobi_cg_apply: w = A z over [lo, hi), reading z[lo-1] and z[hi],
+ *   and accumulate dots[4] = { sum (r/h2)^2, max |r/h2|, (r, z), (w, z) }.
+ *   The first two are the residual norms of the *_res kernels, so the
+ *   reduced dots[] can go straight to jacobi_converged().
+ *
+ * jacobi_cg_update: p = z + beta p, s = w + beta s (= A p), u += alpha p,
+ *   r -= alpha s and z = dinv r, fused into one pass over [lo, hi).
+ *
+ * jacobi_cg_step: alpha and beta for the next update from the reduced
+ *   dots[].  gamma (the previous (r, z)) starts at 0, which makes the
+ *   first call a steepest-descent step; identical inputs give identical
+ *   results, so every thread or rank may call it.
+ */
+void jacobi_cg_init(double* r, double* z, const double* u, const double* f,
+                    double h2, double dinv, int lo, int hi);
+void jacobi_cg_apply(double* w, const double* z, const double* r,
+                     double h2, int lo, int hi, double dots[4]);
+void jacobi_cg_update(double* u, double* r, double* z, double* p, double* s,
+                      const double* w, double alpha, double beta,
+                      double dinv, int lo, int hi);
+void jacobi_cg_step(const double dots[4], double* gamma, double* alpha,
+                    double* beta);
+
+/* --
+ * Whether the drivers use the fused kernel (the default) or the split
+ * double-buffer loop; JACOBI_FUSED=0 selects the latter.
+ */
+int jacobi_use_fused(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* JACOBI_KERNELS_H_ */
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "jacobi_numa.h"
+
+/* From <numaif.h>, which needs libnuma's headers */
+#define NUMA_MPOL_BIND       2
+#define NUMA_MPOL_INTERLEAVE 3
+
+/* Pages asked about per move_pages() call */
+#define NUMA_QUERY 1024
+
+#define NODE_WORDS (JACOBI_NUMA_MAX_NODES / (8 * sizeof(unsigned long)))
+
+static const char* numa_names[] = { "first-touch", "interleave", "bind" };
+
+int jacobi_numa_policy(void)
+{
+    int p;
+    const char* env = getenv("JACOBI_NUMA");
+
+    if (env == NULL)
+        return JACOBI_NUMA_FIRST_TOUCH;
+    for (p = 0; p < 3; ++p)
+        if (strcmp(env, numa_names[p]) == 0)
+            return p;
+    fprintf(stderr, "Unknown JACOBI_NUMA '%s'; using first-touch\n", env);
+    return JACOBI_NUMA_FIRST_TOUCH;
+}
+
+const char* jacobi_numa_name(int policy)
+{
+    return (policy >= 0 && policy < 3) ? numa_names[policy] : "unknown";
+}
+
+int jacobi_numa_nodes(void)
+{
+    int nodes = 0, id;
+    struct dirent* e;
+    DIR* d = opendir("/sys/devices/system/node");
+
+    if (d == NULL)
+        return 1;
+    while ((e = readdir(d)) != NULL)
+        if (sscanf(e->d_name, "node%d", &id) == 1 && id + 1 > nodes)
+            nodes = id + 1;
+    closedir(d);
+    if (nodes > JACOBI_NUMA_MAX_NODES)
+        nodes = JACOBI_NUMA_MAX_NODES;
+    return nodes > 0 ? nodes : 1;
+}
+
+int jacobi_numa_current_node(void)
+{
+    unsigned cpu = 0, node = 0;
+
+#ifdef SYS_getcpu
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+        return 0;
+#endif
+    return (int) node;
+}
+
+static size_t page_doubles(void)
+{
+    return (size_t) sysconf(_SC_PAGESIZE) / sizeof(double);
+}
+
+double* jacobi_numa_alloc(size_t count, int policy)
+{
+    size_t bytes = count * sizeof(double);
+    void* a = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (a == MAP_FAILED)
+        return NULL;
+#ifdef SYS_mbind
+    if (policy == JACOBI_NUMA_INTERLEAVE) {
+        unsigned long mask[NODE_WORDS + 1] = { 0 };
+        int k, nodes = jacobi_numa_nodes();
+        for (k = 0; k < nodes; ++k)
+            mask[k / (8 * sizeof(unsigned long))] |= 1UL << (k % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, a, bytes, NUMA_MPOL_INTERLEAVE, mask,
+                (unsigned long) JACOBI_NUMA_MAX_NODES + 1, 0);
+    }
+#else
+    (void) policy;
+#endif
+    return (double*) a;
+}
+
+void jacobi_numa_free(double* a, size_t count)
+{
+    if (a != NULL)
+        munmap(a, count * sizeof(double));
+}
+
+void jacobi_numa_pages(size_t count, long lo, long hi, size_t* first,
+                       size_t* last)
+{
+    size_t pd = page_doubles();
+    size_t npages = (count + pd - 1) / pd;
+
+    *first = (lo <= 0) ? 0 : ((size_t) lo + pd - 1) / pd;
+    *last  = ((size_t) hi >= count) ? npages : ((size_t) hi + pd - 1) / pd;
+    if (*last < *first)
+        *last = *first;
+}
+
+int jacobi_numa_bind(double* a, size_t first, size_t last, int node)
+{
+#ifdef SYS_mbind
+    unsigned long mask[NODE_WORDS + 1] = { 0 };
+    size_t pd = page_doubles();
+
+    if (last <= first || node < 0 || node >= JACOBI_NUMA_MAX_NODES)
+        return 0;
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    return (int) syscall(SYS_mbind, a + first*pd, (last - first) * pd * sizeof(double),
+                         NUMA_MPOL_BIND, mask,
+                         (unsigned long) JACOBI_NUMA_MAX_NODES + 1, 0);
+#else
+    (void) a; (void) first; (void) last; (void) node;
+    return -1;
+#endif
+}
+
+int jacobi_numa_count(double* a, size_t first, size_t last, long* per_node)
+{
+#ifdef SYS_move_pages
+    void* pages[NUMA_QUERY];
+    int status[NUMA_QUERY];
+    size_t pd = page_doubles();
+    size_t p, k;
+
+    for (p = first; p < last; p += NUMA_QUERY) {
+        size_t m = (last - p < NUMA_QUERY) ? last - p : NUMA_QUERY;
+        for (k = 0; k < m; ++k)
+            pages[k] = a + (p + k) * pd;
+        /* With no target nodes move_pages() only reports where pages are */
+        if (syscall(SYS_move_pages, 0, (unsigned long) m, pages, NULL,
+                    status, 0) != 0)
+            return -1;
+        for (k = 0; k < m; ++k)
+            if (status[k] >= 0 && status[k] < JACOBI_NUMA_MAX_NODES)
+                per_node[status[k]]++;
+    }
+    return 0;
+#else
+    (void) a; (void) first; (void) last; (void) per_node;
+    return -1;
+#endif
+}
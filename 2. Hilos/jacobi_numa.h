@@ -0,0 +1,72 @@
+#ifndef JACOBI_NUMA_H_
+#define JACOBI_NUMA_H_
+
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * NUMA placement of the arrays of a threaded run.  Arrays come from
+ * jacobi_numa_alloc() untouched, so each page lands where it is first
+ * written; with every thread initializing its own chunk, the pages of a
+ * chunk end up on the node of the thread that sweeps it.  The policy is
+ * chosen with the JACOBI_NUMA environment variable:
+ *
+ *    first-touch  rely on the kernel's default local allocation (default)
+ *    interleave   spread every array round-robin over all nodes
+ *    bind         bind each thread's pages to its node before touching
+ *
+ * The kernel calls (mbind, move_pages, getcpu) are made through
+ * syscall(), so no libnuma is needed; where they are not available the
+ * policies fall back to first-touch and the report says so.
+ */
+enum {
+    JACOBI_NUMA_FIRST_TOUCH,
+    JACOBI_NUMA_INTERLEAVE,
+    JACOBI_NUMA_BIND
+};
+
+/* Largest node count handled */
+#define JACOBI_NUMA_MAX_NODES 64
+
+int jacobi_numa_policy(void);
+const char* jacobi_numa_name(int policy);
+
+/* Memory nodes of the machine (1 without NUMA) */
+int jacobi_numa_nodes(void);
+
+/* Node of the CPU the calling thread runs on (0 if unknown) */
+int jacobi_numa_current_node(void);
+
+/* --
+ * count doubles on fresh, page-aligned, untouched pages; with the
+ * interleave policy the whole range is interleaved over all nodes.
+ */
+double* jacobi_numa_alloc(size_t count, int policy);
+void jacobi_numa_free(double* a, size_t count);
+
+/* --
+ * Pages of an array of count doubles that belong to the chunk [lo, hi):
+ * those that start inside it, the first chunk also taking the page of
+ * a[0].  The chunks of a partition of [0, count) split the pages.
+ */
+void jacobi_numa_pages(size_t count, long lo, long hi, size_t* first,
+                       size_t* last);
+
+/* Bind pages [first, last) of a to node (the bind policy) */
+int jacobi_numa_bind(double* a, size_t first, size_t last, int node);
+
+/* --
+ * Add the number of resident pages [first, last) of a has on each node
+ * to per_node[] (JACOBI_NUMA_MAX_NODES entries).  Returns 0, or -1 if the
+ * kernel cannot tell.
+ */
+int jacobi_numa_count(double* a, size_t first, size_t last, long* per_node);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* JACOBI_NUMA_H_ */
@@ -0,0 +1,139 @@
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jacobi_sync.h"
+
+/* Pause instructions before a waiting thread starts yielding the CPU */
+#define SYNC_MAX_SPINS 1024
+
+static const char* sync_names[] = { "pthread", "spin", "neighbor" };
+
+int jacobi_sync_mode(void)
+{
+    int m;
+    const char* env = getenv("JACOBI_SYNC");
+
+    if (env == NULL)
+        return JACOBI_SYNC_PTHREAD;
+    for (m = 0; m < 3; ++m)
+        if (strcmp(env, sync_names[m]) == 0)
+            return m;
+    fprintf(stderr, "Unknown JACOBI_SYNC '%s'; using pthread\n", env);
+    return JACOBI_SYNC_PTHREAD;
+}
+
+const char* jacobi_sync_name(int mode)
+{
+    return (mode >= 0 && mode < 3) ? sync_names[mode] : "unknown";
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/* Bounded exponential backoff: double the pause up to the bound, then
+ * yield, so waiting still makes progress with more threads than CPUs */
+static inline void backoff(int* spins)
+{
+    int i;
+
+    if (*spins < SYNC_MAX_SPINS) {
+        for (i = 0; i < *spins; ++i)
+            cpu_relax();
+        *spins *= 2;
+    } else {
+        sched_yield();
+    }
+}
+
+void jacobi_sync_init(jacobi_sync_t* s, int num_threads, int mode,
+                      int min_chunk)
+{
+    memset(s, 0, sizeof(*s));
+    s->mode = mode;
+    s->num_threads = num_threads;
+    jacobi_sync_set_chunk(s, min_chunk);
+    pthread_barrier_init(&s->barrier, NULL, num_threads);
+    s->slot = (jacobi_sync_slot_t*) aligned_alloc(JACOBI_SYNC_LINE,
+                  num_threads * sizeof(jacobi_sync_slot_t));
+    memset(s->slot, 0, num_threads * sizeof(jacobi_sync_slot_t));
+}
+
+void jacobi_sync_set_chunk(jacobi_sync_t* s, int min_chunk)
+{
+    if (min_chunk >= 2)
+        s->reach = 1;
+    else if (min_chunk == 1)
+        s->reach = 2;
+    else
+        s->reach = s->num_threads;    /* empty chunks: wait for everybody */
+}
+
+void jacobi_sync_destroy(jacobi_sync_t* s)
+{
+    pthread_barrier_destroy(&s->barrier);
+    free(s->slot);
+}
+
+static void spin_barrier(jacobi_sync_t* s, int tid)
+{
+    int spins = 1;
+    int sense = !s->slot[tid].sense;
+
+    s->slot[tid].sense = sense;
+    if (__atomic_add_fetch(&s->count, 1, __ATOMIC_ACQ_REL) == s->num_threads) {
+        /* Last one in: reset the count, then release everybody */
+        __atomic_store_n(&s->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->sense, sense, __ATOMIC_RELEASE);
+    } else {
+        while (__atomic_load_n(&s->sense, __ATOMIC_ACQUIRE) != sense)
+            backoff(&spins);
+    }
+}
+
+/* Publish the next epoch of tid and wait for threads lo .. hi to reach it */
+static void epoch_wait(jacobi_sync_t* s, int tid, int lo, int hi)
+{
+    int t;
+    unsigned long e = s->slot[tid].epoch + 1;
+
+    __atomic_store_n(&s->slot[tid].epoch, e, __ATOMIC_RELEASE);
+    if (lo < 0)
+        lo = 0;
+    if (hi > s->num_threads - 1)
+        hi = s->num_threads - 1;
+    for (t = lo; t <= hi; ++t) {
+        int spins = 1;
+        while (__atomic_load_n(&s->slot[t].epoch, __ATOMIC_ACQUIRE) < e)
+            backoff(&spins);
+    }
+}
+
+void jacobi_sync_all(jacobi_sync_t* s, int tid)
+{
+    switch (s->mode) {
+    case JACOBI_SYNC_SPIN:
+        spin_barrier(s, tid);
+        break;
+    case JACOBI_SYNC_NEIGHBOR:
+        epoch_wait(s, tid, 0, s->num_threads - 1);
+        break;
+    default:
+        pthread_barrier_wait(&s->barrier);
+    }
+}
+
+void jacobi_sync_neighbors(jacobi_sync_t* s, int tid)
+{
+    if (s->mode == JACOBI_SYNC_NEIGHBOR)
+        epoch_wait(s, tid, tid - s->reach, tid + s->reach);
+    else
+        jacobi_sync_all(s, tid);
+}
@@ -0,0 +1,85 @@
+#ifndef JACOBI_SYNC_H_
+#define JACOBI_SYNC_H_
+
+#include <pthread.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * Synchronization between the sweeps of the pthread programs.  Three
+ * modes, chosen with the JACOBI_SYNC environment variable:
+ *
+ *    pthread   pthread_barrier_wait (the default)
+ *    spin      sense-reversing spin barrier: one shared counter and sense
+ *              flag on their own cache lines, each thread spins on the
+ *              flag with exponential backoff (pause) and, once the backoff
+ *              reaches its bound, yields the CPU between checks
+ *    neighbor  point-to-point: every thread publishes an epoch counter on
+ *              its own cache line and jacobi_sync_neighbors() only waits
+ *              for the epochs of the chunks to its left and right, which
+ *              is all a Jacobi or red-black sweep reads
+ *
+ * jacobi_sync_all() is a full barrier in every mode (in neighbor mode it
+ * waits for every epoch); use it where a thread reads more than its
+ * neighbours' data, e.g. before summing the residual partials.
+ */
+enum {
+    JACOBI_SYNC_PTHREAD,
+    JACOBI_SYNC_SPIN,
+    JACOBI_SYNC_NEIGHBOR
+};
+
+#define JACOBI_SYNC_LINE 64
+
+/* Per-thread state, one cache line each */
+typedef struct {
+    unsigned long epoch;    /* syncs passed; read by other threads in neighbor mode */
+    int sense;              /* local sense of the spin barrier */
+    char pad[JACOBI_SYNC_LINE - sizeof(unsigned long) - sizeof(int)];
+} jacobi_sync_slot_t;
+
+typedef struct {
+    int mode;
+    int num_threads;
+    int reach;              /* chunks on each side a neighbor sync waits for */
+    pthread_barrier_t barrier;
+    char pad0[JACOBI_SYNC_LINE];
+    int count;              /* threads arrived at the spin barrier */
+    char pad1[JACOBI_SYNC_LINE - sizeof(int)];
+    int sense;              /* flipped by the last thread to arrive */
+    char pad2[JACOBI_SYNC_LINE - sizeof(int)];
+    jacobi_sync_slot_t* slot;
+} jacobi_sync_t;
+
+/* Mode from JACOBI_SYNC (pthread, spin or neighbor; default pthread) */
+int jacobi_sync_mode(void);
+
+/* Name of a mode, as accepted by JACOBI_SYNC */
+const char* jacobi_sync_name(int mode);
+
+/* --
+ * Set up for num_threads threads.  min_chunk is the smallest number of
+ * points a thread owns: the fused kernel reads two points beyond its
+ * chunk, so with chunks of one point a neighbor sync has to wait for
+ * the chunks two away as well (and for everybody if some are empty).
+ */
+void jacobi_sync_init(jacobi_sync_t* s, int num_threads, int mode,
+                      int min_chunk);
+void jacobi_sync_destroy(jacobi_sync_t* s);
+
+/* Update min_chunk when the same threads move on to another problem */
+void jacobi_sync_set_chunk(jacobi_sync_t* s, int min_chunk);
+
+/* Full barrier for thread tid */
+void jacobi_sync_all(jacobi_sync_t* s, int tid);
+
+/* Wait only for the neighbours of tid (a full barrier unless neighbor mode) */
+void jacobi_sync_neighbors(jacobi_sync_t* s, int tid);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* JACOBI_SYNC_H_ */
@@ -0,0 +1,79 @@
+#ifndef JACOBI_TOPO_H_
+#define JACOBI_TOPO_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * CPU topology and placement of the workers (threads or processes) of a
+ * run.  The topology comes from /sys/devices/system/cpu and is limited to
+ * the CPUs the process may run on (its affinity mask, which also carries
+ * any cgroup cpuset).  The policy is chosen with the JACOBI_PLACE
+ * environment variable:
+ *
+ *    compact   fill the hardware threads of a core, then the next core of
+ *              the same cache, then the next cache and socket
+ *    core      one worker per physical core (default); SMT siblings are
+ *              only used once every core has a worker
+ *    scatter   one core of each last-level cache in turn, alternating
+ *              sockets, to spread the memory bandwidth
+ *    l3        one worker per last-level cache; extra workers wrap around
+ *    none      do not pin
+ *
+ * Whatever CPUs a policy picks, worker t runs chunk t of the domain, so
+ * the picked CPUs are handed out in topology order: neighbouring chunks,
+ * which exchange their boundary values every sweep, end up on the same
+ * core or cache whenever the policy allows it.
+ */
+enum {
+    JACOBI_PLACE_CORE,
+    JACOBI_PLACE_COMPACT,
+    JACOBI_PLACE_SCATTER,
+    JACOBI_PLACE_L3,
+    JACOBI_PLACE_NONE
+};
+
+typedef struct {
+    int cpu;        /* logical CPU number */
+    int package;    /* physical_package_id */
+    int llc;        /* lowest CPU sharing its last-level cache */
+    int l2;         /* lowest CPU sharing its L2 */
+    int core;       /* lowest CPU among its SMT siblings */
+    int smt;        /* rank among its SMT siblings */
+} jacobi_cpu_t;
+
+typedef struct {
+    int ncpus;
+    jacobi_cpu_t* cpu;  /* in topology order */
+} jacobi_topo_t;
+
+/* Policy from JACOBI_PLACE (default core) */
+int jacobi_place_policy(void);
+const char* jacobi_place_name(int policy);
+
+/* Read the topology of the allowed CPUs; returns their number */
+int jacobi_topo_load(jacobi_topo_t* t);
+void jacobi_topo_free(jacobi_topo_t* t);
+
+/* --
+ * CPU for each of nworkers workers (cpus[w] = -1 with policy none).
+ * With more workers than CPUs picked, the list wraps around.
+ */
+void jacobi_topo_place(const jacobi_topo_t* t, int policy, int nworkers,
+                       int* cpus);
+
+/* jacobi_topo_place() on a freshly loaded topology */
+void jacobi_place(int policy, int nworkers, int* cpus);
+
+/* Pin the calling thread or process to cpu (nothing if cpu < 0) */
+int jacobi_pin_self(int cpu);
+
+/* Print "place: <policy> (cpus ...)" */
+void jacobi_place_print(int policy, int nworkers, const int* cpus);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* JACOBI_TOPO_H_ */
@@ -1,9 +1,19 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <float.h>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "tridiag.h"
+#include "jacobi_sync.h"
+#include "jacobi_part.h"
 
 /* Thread argument structure to pass all necessary data to each thread */
 typedef struct {
@@ -16,13 +26,26 @@ typedef struct {
     double h2;           // Square of the grid spacing
     int start;           // Start index for this thread
     int end;             // End index for this thread
-    pthread_barrier_t* barrier; // Synchronization barrier
+    jacobi_sync_t* sync;        // Barrier or neighbour sync between sweeps
+    jacobi_sweep_t half_sweep;  // Vectorized half-sweep kernel
+    jacobi_fused_t fused_sweep; // Fused two-sweep kernel (NULL for the split loop)
+    jacobi_sweep_res_t sweep_res; // Half-sweep that also accumulates the residual
+    jacobi_fused_res_t fused_res; // Fused kernel that also accumulates the residual
+    int num_threads;            // Number of threads sharing the partials
+    const jacobi_opts_t* opts;  // Residual check settings (NULL: fixed sweep count)
+    double* partials;           // Residual partials, 2 sets x 2 per thread (shared)
+    jacobi_stats_t stats;       // Sweeps done and last residual seen by this thread
+    int solver;                 // JACOBI_SOLVER_JACOBI, _WJACOBI, _RBGS, _SOR or _CHEBYSHEV
+    double omega;               // Relaxation weight of the wjacobi/rbgs/sor schemes
+    int* sep;                   // Separators of the direct solver (shared, num_threads+1)
+    int nparts;                 // Threads with a non-empty chunk (the first nparts)
+    unsigned generation;        // Pool generation when the worker was started
 } thread_data_t;
 
 /* Thread function for the Jacobi iteration */
 void* jacobi_worker(void* arg) {
     thread_data_t* data = (thread_data_t*)arg;
-    int i, sweep;
+    int sweep;
     
     // Extract data from the thread structure
     int start = data->start;
@@ -32,45 +55,308 @@ void* jacobi_worker(void* arg) {
     double* f = data->f;
     double h2 = data->h2;
     int nsweeps = data->nsweeps;
-    pthread_barrier_t* barrier = data->barrier;
+    jacobi_sync_t* sync = data->sync;
+    int tid = data->thread_id;
+    jacobi_sweep_t half_sweep = data->half_sweep;
+    jacobi_fused_t fused_sweep = data->fused_sweep;
+    double* parts = data->partials;
+    double* norms = parts;
+    double total[2];
+    double halo[4];
+    double omega = data->omega;
+    int flags, check, color, done = 0;
     
-    for (sweep = 0; sweep < nsweeps; sweep += 2) {
-        // First half-sweep: update utmp using values from u
-        for (i = start; i < end; ++i) {
-            utmp[i] = (u[i-1] + u[i+1] + h2*f[i])/2;
+    for (sweep = 0; sweep < nsweeps - 1 && !done; sweep += 2) {
+        // Every few sweeps the first half-sweep also measures the residual
+        check = jacobi_check_due(data->opts, sweep);
+        if (check) {
+            // Consecutive checks alternate between two sets of partials, so a
+            // fast thread never overwrites values a slow one is still reading
+            parts = data->partials
+                  + 2 * data->num_threads * (sweep / data->opts->check % 2);
+            norms = parts + 2 * data->thread_id;
+            norms[0] = norms[1] = 0;
         }
         
-        // Synchronize all threads before the second half-sweep
-        pthread_barrier_wait(barrier);
-        
-        // Second half-sweep: update u using values from utmp
-        for (i = start; i < end; ++i) {
-            u[i] = (utmp[i-1] + utmp[i+1] + h2*f[i])/2;
+        if (data->solver == JACOBI_SOLVER_WJACOBI) {
+            // Damped Jacobi, double-buffered like the split loop
+            jacobi_weighted_sweep(utmp, u, f, h2, omega, start, end,
+                                  check ? norms : NULL);
+            jacobi_sync_neighbors(sync, tid);
+            jacobi_weighted_sweep(u, utmp, f, h2, omega, start, end, NULL);
+        } else if (data->solver == JACOBI_SOLVER_CHEBYSHEV) {
+            // Chebyshev: the same double buffer, each array also holding the
+            // iterate before the one in the other array.  Every thread steps
+            // the weights itself and gets the same values
+            omega = jacobi_chebyshev_omega(data->n, sweep, omega);
+            jacobi_chebyshev_sweep(utmp, u, f, h2, omega, start, end,
+                                   check ? norms : NULL);
+            jacobi_sync_neighbors(sync, tid);
+            omega = jacobi_chebyshev_omega(data->n, sweep + 1, omega);
+            jacobi_chebyshev_sweep(u, utmp, f, h2, omega, start, end, NULL);
+        } else if (data->solver != JACOBI_SOLVER_JACOBI) {
+            // Red-black GS/SOR in place: measure u before anyone changes it,
+            // then red, black, red, black with a barrier between colors
+            if (check) {
+                jacobi_residual(u, f, h2, start, end, norms);
+                jacobi_sync_neighbors(sync, tid);
+            }
+            for (color = 0; color < 4; ++color) {
+                if (color > 0)
+                    jacobi_sync_neighbors(sync, tid);
+                jacobi_rb_sweep(u, f, h2, omega, start, end, color & 1);
+            }
+        } else if (fused_sweep != NULL) {
+            // Save the old values around this chunk before anyone overwrites them
+            flags = jacobi_halo(u, start, end, start == 1, end == data->n, halo);
+            jacobi_sync_neighbors(sync, tid);
+            
+            // Both sweeps in place: u^k -> u^{k+2}
+            if (check)
+                data->fused_res(u, f, h2, start, end, halo, flags, norms);
+            else
+                fused_sweep(u, f, h2, start, end, halo, flags);
+        } else {
+            // First half-sweep: update utmp using values from u
+            if (check)
+                data->sweep_res(utmp, u, f, h2, start, end, norms);
+            else
+                half_sweep(utmp, u, f, h2, start, end);
+            
+            // Wait for the neighbours before the second half-sweep
+            jacobi_sync_neighbors(sync, tid);
+            
+            // Second half-sweep: update u using values from utmp
+            half_sweep(u, utmp, f, h2, start, end);
         }
         
-        // Synchronize all threads before the next sweep
-        pthread_barrier_wait(barrier);
+        // Synchronize before the next sweep; summing the partials needs
+        // every thread, the sweep itself only the neighbours
+        if (check)
+            jacobi_sync_all(sync, tid);
+        else
+            jacobi_sync_neighbors(sync, tid);
+        
+        // All partials are in; every thread reduces them the same way and
+        // so takes the same decision without another barrier
+        if (check) {
+            jacobi_sum_norms(parts, data->num_threads, total);
+            done = jacobi_converged(data->opts, &data->stats, sweep, total,
+                                    1.0 / data->n);
+        }
+    }
+    
+    // If nsweeps is odd, do one extra sweep (into utmp and copied back to u
+    // for the Jacobi schemes)
+    if (nsweeps % 2 != 0 && !done) {
+        if (data->solver == JACOBI_SOLVER_RBGS || data->solver == JACOBI_SOLVER_SOR) {
+            jacobi_rb_sweep(u, f, h2, omega, start, end, 0);
+            jacobi_sync_neighbors(sync, tid);
+            jacobi_rb_sweep(u, f, h2, omega, start, end, 1);
+        } else {
+            if (data->solver == JACOBI_SOLVER_WJACOBI) {
+                jacobi_weighted_sweep(utmp, u, f, h2, omega, start, end, NULL);
+            } else if (data->solver == JACOBI_SOLVER_CHEBYSHEV) {
+                omega = jacobi_chebyshev_omega(data->n, sweep, omega);
+                jacobi_chebyshev_sweep(utmp, u, f, h2, omega, start, end, NULL);
+            } else {
+                half_sweep(utmp, u, f, h2, start, end);
+            }
+            jacobi_sync_neighbors(sync, tid);
+            memcpy(u + start, utmp + start, (end - start) * sizeof(double));
+        }
+        ++sweep;
+    }
+    data->stats.sweeps = sweep;
+    
+    return NULL;
+}
+
+/*
+ * Thread function for the direct solve (--solver direct): partitioned
+ * Thomas algorithm.  The last point of every chunk but the last is a
+ * separator; each thread solves the rest of its chunk with zero ends,
+ * thread 0 solves for the separators and then each thread adds the
+ * straight line between its two separators.
+ */
+void* direct_worker(void* arg) {
+    thread_data_t* data = (thread_data_t*)arg;
+    int p = data->thread_id;
+    int nparts = data->nparts;
+    double* u = data->u;
+    int lo = data->start;
+    int hi = (p == nparts - 1) ? data->end : data->end - 1;
+    double* y = data->partials;
+    int q;
+    
+    // Phase 1: independent solves, utmp as scratch (threads with an empty
+    // chunk only take part in the barriers)
+    if (p < nparts) {
+        tridiag_block(u, data->f, data->h2, lo, hi, data->utmp);
+        y[2*p] = u[lo];
+        y[2*p + 1] = u[hi - 1];
+        data->sep[p + 1] = hi;
+    }
+    if (p == 0)
+        data->sep[0] = 0;
+    jacobi_sync_all(data->sync, p);
+    
+    // Phase 2: the small system for the separators
+    if (p == 0 && nparts > 1) {
+        double* x = (double*) malloc((4*nparts + 2) * sizeof(double));
+        double* fsep = x + nparts + 1;
+        for (q = 0; q <= nparts; q++) {
+            fsep[q] = data->f[data->sep[q]];
+            x[q] = u[data->sep[q]];
+        }
+        tridiag_interface(nparts, data->sep, y, fsep, data->h2, x, fsep + nparts + 1);
+        for (q = 1; q < nparts; q++)
+            u[data->sep[q]] = x[q];
+        free(x);
     }
+    jacobi_sync_all(data->sync, p);
+    
+    // Phase 3: add the homogeneous solution
+    if (p < nparts)
+        tridiag_correct(u, lo, hi, u[lo - 1], u[hi]);
     
     return NULL;
 }
 
+/*
+ * Persistent worker pool.  The workers, their thread_data, the barrier
+ * and the workspaces (utmp, residual partials, separators) outlive a
+ * call to jacobi_parallel(), so repeated solves pay no thread creation
+ * or allocation.  Between jobs the workers sleep on a condition variable
+ * (a futex on Linux); a job is handed over by filling thread_data and
+ * bumping the generation counter, and the caller sleeps until the last
+ * worker reports back.  The pool is rebuilt only when the thread count
+ * changes, and utmp only grows.
+ */
+typedef struct {
+    int num_threads;            // Workers in the pool (0: not started)
+    pthread_t* threads;
+    thread_data_t* thread_data;
+    jacobi_sync_t sync;         // Sweep synchronization, shared by every job
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // Signalled when a job is posted
+    pthread_cond_t done;        // Signalled by the last worker to finish
+    unsigned generation;        // Jobs posted so far
+    int pending;                // Workers still busy with the current job
+    int shutdown;               // Tells the workers to exit
+    double* utmp;               // Workspace for grids of up to capacity+1 points
+    int capacity;
+    double* partials;           // Residual partials, 4 per thread
+    int* sep;                   // Separators of the direct solver
+    int* bounds;                // Chunk of each thread in the last job (num_threads+1)
+} jacobi_pool_t;
+
+static jacobi_pool_t pool = { .lock = PTHREAD_MUTEX_INITIALIZER,
+                              .wake = PTHREAD_COND_INITIALIZER,
+                              .done = PTHREAD_COND_INITIALIZER };
+
+/* Worker loop: wait for a job, run it, report, repeat */
+static void* pool_worker(void* arg) {
+    thread_data_t* data = (thread_data_t*)arg;
+    unsigned seen = data->generation;   // Jobs posted before this pool don't count
+    int shutdown;
+    
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.generation == seen && !pool.shutdown)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        seen = pool.generation;
+        shutdown = pool.shutdown;
+        pthread_mutex_unlock(&pool.lock);
+        if (shutdown)
+            break;
+        
+        if (data->solver == JACOBI_SOLVER_DIRECT)
+            direct_worker(data);
+        else
+            jacobi_worker(data);
+        
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.pending == 0)
+            pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+/* Stop and join the workers and free the workspaces */
+void jacobi_pool_shutdown(void) {
+    int i;
+    
+    if (pool.num_threads == 0)
+        return;
+    pthread_mutex_lock(&pool.lock);
+    pool.shutdown = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    for (i = 0; i < pool.num_threads; i++)
+        pthread_join(pool.threads[i], NULL);
+    
+    jacobi_sync_destroy(&pool.sync);
+    free(pool.threads);
+    free(pool.thread_data);
+    free(pool.partials);
+    free(pool.sep);
+    free(pool.bounds);
+    free(pool.utmp);
+    pool.threads = NULL;
+    pool.thread_data = NULL;
+    pool.partials = NULL;
+    pool.sep = NULL;
+    pool.bounds = NULL;
+    pool.utmp = NULL;
+    pool.capacity = 0;
+    pool.num_threads = 0;
+    pool.shutdown = 0;
+}
+
+/* Start num_threads workers, each pinned to a CPU (cyclically) */
+static void pool_start(int num_threads) {
+    int i;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    pool.num_threads = num_threads;
+    pool.threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+    pool.thread_data = (thread_data_t*) calloc(num_threads, sizeof(thread_data_t));
+    pool.partials = (double*) calloc(4 * num_threads, sizeof(double));
+    pool.sep = (int*) malloc((num_threads + 1) * sizeof(int));
+    pool.bounds = (int*) malloc((num_threads + 1) * sizeof(int));
+    jacobi_sync_init(&pool.sync, num_threads, jacobi_sync_mode(), 0);
+    pthread_mutex_lock(&pool.lock);
+    for (i = 0; i < num_threads; i++)
+        pool.thread_data[i].generation = pool.generation;
+    pthread_mutex_unlock(&pool.lock);
+    
+    for (i = 0; i < num_threads; i++) {
+        cpu_set_t cpuset;
+        pthread_create(&pool.threads[i], NULL, pool_worker, &pool.thread_data[i]);
+        CPU_ZERO(&cpuset);
+        CPU_SET(ncpu > 0 ? i % ncpu : 0, &cpuset);
+        if (pthread_setaffinity_np(pool.threads[i], sizeof(cpu_set_t), &cpuset) != 0)
+            fprintf(stderr, "Could not pin thread %d\n", i);
+    }
+}
+
 /* 
  * Multi-threaded Jacobi iteration method
- * num_threads specifies how many threads to use for the computation
+ * num_threads specifies how many threads to use for the computation.
+ * opts (may be NULL) turns on residual checks and early stopping;
+ * stats (may be NULL) gets the sweeps done and the last residual.
+ * The work runs on the persistent pool, started on the first call.
  */
-void jacobi_parallel(int nsweeps, int n, double* u, double* f, int num_threads) {
+void jacobi_parallel(int nsweeps, int n, double* u, double* f, int num_threads,
+                     const jacobi_opts_t* opts, jacobi_stats_t* stats) {
     int i;
     double h = 1.0 / n;
     double h2 = h*h;
-    double* utmp = (double*) malloc((n+1) * sizeof(double));
-    pthread_t* threads;
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
+    jacobi_fused_t fused_sweep = jacobi_use_fused() ? jacobi_fused_kernel() : NULL;
     thread_data_t* thread_data;
-    pthread_barrier_t barrier;
-    
-    /* Initialize the temporary array with boundary conditions */
-    utmp[0] = u[0];
-    utmp[n] = u[n];
     
     /* Adjust the number of threads if we have too many compared to problem size */
     if (num_threads > n-1) {
@@ -78,19 +364,26 @@ void jacobi_parallel(int nsweeps, int n, double* u, double* f, int num_threads)
         printf("Reducing number of threads to %d based on problem size.\n", num_threads);
     }
     
-    /* Allocate thread structures */
-    threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
-    thread_data = (thread_data_t*) malloc(num_threads * sizeof(thread_data_t));
-    
-    /* Initialize the barrier for thread synchronization */
-    pthread_barrier_init(&barrier, NULL, num_threads);
+    /* (Re)start the pool if the thread count changed; grow the workspace */
+    if (pool.num_threads != num_threads) {
+        jacobi_pool_shutdown();
+        pool_start(num_threads);
+    }
+    if (pool.capacity < n) {
+        free(pool.utmp);
+        pool.utmp = jacobi_alloc(n+1);
+        pool.capacity = n;
+    }
+    thread_data = pool.thread_data;
     
-    /* Calculate the workload distribution */
-    int points_per_thread = (n-1) / num_threads;
-    int remainder = (n-1) % num_threads;
+    /* Initialize the temporary array with boundary conditions */
+    pool.utmp[0] = u[0];
+    pool.utmp[n] = u[n];
     
-    /* Create and launch the threads */
-    int start = 1; // Skip the first boundary point
+    /* Calculate the workload distribution: chunk edges on cache lines */
+    int grain = jacobi_grain();
+    jacobi_partition(n, num_threads, grain, pool.bounds);
+    jacobi_sync_set_chunk(&pool.sync, jacobi_part_min(num_threads, pool.bounds));
     
     for (i = 0; i < num_threads; i++) {
         // Calculate the range for this thread
@@ -98,49 +391,47 @@ void jacobi_parallel(int nsweeps, int n, double* u, double* f, int num_threads)
         thread_data[i].n = n;
         thread_data[i].nsweeps = nsweeps;
         thread_data[i].u = u;
-        thread_data[i].utmp = utmp;
+        thread_data[i].utmp = pool.utmp;
         thread_data[i].f = f;
         thread_data[i].h2 = h2;
-        thread_data[i].start = start;
-        
-        // Calculate how many points this thread will process
-        int points = points_per_thread;
-        if (i < remainder) {
-            points++; // Distribute the remainder among the first 'remainder' threads
-        }
-        
-        thread_data[i].end = start + points;
-        start = thread_data[i].end;
-        
-        // Note that we need to ensure that end <= n
-        if (thread_data[i].end > n) {
-            thread_data[i].end = n;
-        }
-        
-        thread_data[i].barrier = &barrier;
-        
-        // Create the thread
-        pthread_create(&threads[i], NULL, jacobi_worker, &thread_data[i]);
+        thread_data[i].start = pool.bounds[i];
+        thread_data[i].end = pool.bounds[i+1];
+        thread_data[i].sync = &pool.sync;
+        thread_data[i].half_sweep = half_sweep;
+        thread_data[i].fused_sweep = fused_sweep;
+        thread_data[i].sweep_res = jacobi_sweep_res_kernel();
+        thread_data[i].fused_res = jacobi_fused_res_kernel();
+        thread_data[i].num_threads = num_threads;
+        thread_data[i].opts = opts;
+        thread_data[i].partials = pool.partials;
+        memset(&thread_data[i].stats, 0, sizeof(jacobi_stats_t));
+        thread_data[i].solver = opts ? opts->solver : JACOBI_SOLVER_JACOBI;
+        thread_data[i].omega = opts ? jacobi_omega(opts, n) : 1.0;
+        thread_data[i].sep = pool.sep;
+        thread_data[i].nparts = jacobi_part_count(n, num_threads, grain);
     }
     
-    /* Wait for all threads to complete */
-    for (i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
-    }
+    /* Hand the job to the workers and wait until all of them are done */
+    pthread_mutex_lock(&pool.lock);
+    pool.pending = num_threads;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    while (pool.pending > 0)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
     
-    /* Clean up */
-    pthread_barrier_destroy(&barrier);
-    free(threads);
-    free(thread_data);
-    free(utmp);
+    /* All threads saw the same residuals; report thread 0's */
+    if (stats)
+        *stats = thread_data[0].stats;
 }
 
 /* Original sequential implementation kept for reference */
 void jacobi_sequential(int nsweeps, int n, double* u, double* f) {
-    int i, sweep;
+    int sweep;
     double h = 1.0 / n;
     double h2 = h*h;
-    double* utmp = (double*) malloc((n+1) * sizeof(double));
+    double* utmp = jacobi_alloc(n+1);
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
 
     /* Fill boundary conditions into utmp */
     utmp[0] = u[0];
@@ -148,19 +439,18 @@ void jacobi_sequential(int nsweeps, int n, double* u, double* f) {
 
     for (sweep = 0; sweep < nsweeps; sweep += 2) {
         /* Old data in u; new data in utmp */
-        for (i = 1; i < n; ++i)
-            utmp[i] = (u[i-1] + u[i+1] + h2*f[i])/2;
+        half_sweep(utmp, u, f, h2, 1, n);
         
         /* Old data in utmp; new data in u */
-        for (i = 1; i < n; ++i)
-            u[i] = (utmp[i-1] + utmp[i+1] + h2*f[i])/2;
+        half_sweep(u, utmp, f, h2, 1, n);
     }
 
     free(utmp);
 }
 
 /* The main function - now modified to accept number of threads as a parameter */
-void jacobi(int nsweeps, int n, double* u, double* f) {
+void jacobi_tol(int nsweeps, int n, double* u, double* f,
+                const jacobi_opts_t* opts, jacobi_stats_t* stats) {
     // Default to 4 threads if not specified in the environment
     int num_threads = 4;
     
@@ -174,7 +464,11 @@ void jacobi(int nsweeps, int n, double* u, double* f) {
     }
     
     // Use parallel version
-    jacobi_parallel(nsweeps, n, u, f, num_threads);
+    jacobi_parallel(nsweeps, n, u, f, num_threads, opts, stats);
+}
+
+void jacobi(int nsweeps, int n, double* u, double* f) {
+    jacobi_tol(nsweeps, n, u, f, NULL, NULL);
 }
 
 void write_solution(int n, double* u, const char* fname) {
@@ -195,8 +489,19 @@ int main(int argc, char** argv) {
     timing_t tstart, tend;
     char* fname;
     int num_threads = 8; // Default number of threads
+    int repeats = 1;     // Solves to time (JACOBI_REPEAT)
+    int status = 0;
+    jacobi_opts_t opts;
+    jacobi_stats_t stats = { 0, 0, 0, 0 };
 
     /* Process arguments */
+    jacobi_parse_opts(&argc, argv, &opts);
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_WJACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_RBGS) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_SOR) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CHEBYSHEV) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_DIRECT));
     n      = (argc > 1) ? atoi(argv[1]) : 100;
     nsteps = (argc > 2) ? atoi(argv[2]) : 100;
     fname  = (argc > 3) ? argv[3] : NULL;
@@ -210,26 +515,87 @@ int main(int argc, char** argv) {
         setenv("JACOBI_NUM_THREADS", thread_env, 1);
     }
     
+    // Repeated solves reuse the thread pool; the time reported is per solve
+    if (getenv("JACOBI_REPEAT") != NULL && atoi(getenv("JACOBI_REPEAT")) > 0)
+        repeats = atoi(getenv("JACOBI_REPEAT"));
+    
     h = 1.0/n;
 
     /* Allocate and initialize arrays */
-    u = (double*) malloc((n+1) * sizeof(double));
-    f = (double*) malloc((n+1) * sizeof(double));
+    u = jacobi_alloc(n+1);
+    f = jacobi_alloc(n+1);
     memset(u, 0, (n+1) * sizeof(double));
     for (i = 0; i <= n; ++i)
         f[i] = i * h;
 
     /* Run the solver */
     get_time(&tstart);
-    jacobi(nsteps, n, u, f);
+    for (i = 0; i < repeats; ++i) {
+        if (i > 0)
+            memset(u, 0, (n+1) * sizeof(double));
+        jacobi_tol(nsteps, n, u, f, &opts, &stats);
+    }
     get_time(&tend);
 
     /* Print results */    
     printf("n: %d\n"
            "nsteps: %d\n"
            "threads: %d\n"
+           "solver: %s\n"
+           "kernel: %s\n"
+           "sync: %s\n"
+           "repeats: %d\n"
            "Elapsed time: %g s\n", 
-           n, nsteps, num_threads, timespec_diff(tstart, tend));
+           n, nsteps, num_threads, jacobi_solver_name(opts.solver),
+           jacobi_kernel_name(jacobi_kernel(n)),
+           jacobi_sync_name(jacobi_sync_mode()), repeats,
+           timespec_diff(tstart, tend) / repeats);
+    if (pool.num_threads > 0)
+        jacobi_part_print(pool.num_threads, pool.bounds);
+    jacobi_pool_shutdown();
+    jacobi_print_stats(&opts, &stats);
+    
+    // JACOBI_POOL_CHECK=k: k more solves, changing the thread count on
+    // every call (num_threads, num_threads-1, ..., 1, num_threads, ...) so
+    // the pool is rebuilt each time, compared with a one-thread solve.  The
+    // iterations must match bit for bit; the partitioned direct solver
+    // rounds differently with each partition, up to about n^2 eps
+    if (getenv("JACOBI_POOL_CHECK") != NULL && atoi(getenv("JACOBI_POOL_CHECK")) > 0) {
+        int calls = atoi(getenv("JACOBI_POOL_CHECK"));
+        int c, t, bad = 0;
+        double diff = 0, scale = 0, tol;
+        double* ref = jacobi_alloc(n+1);
+        double* v = jacobi_alloc(n+1);
+        
+        memset(ref, 0, (n+1) * sizeof(double));
+        jacobi_parallel(nsteps, n, ref, f, 1, &opts, NULL);
+        for (i = 0; i <= n; ++i)
+            if (fabs(ref[i]) > scale)
+                scale = fabs(ref[i]);
+        tol = (opts.solver == JACOBI_SOLVER_DIRECT) ? DBL_EPSILON * n * n * scale : 0;
+        for (c = 0; c < calls; ++c) {
+            double d = 0;
+            t = num_threads - c % num_threads;
+            memset(v, 0, (n+1) * sizeof(double));
+            jacobi_parallel(nsteps, n, v, f, t, &opts, NULL);
+            for (i = 0; i <= n; ++i)
+                if (fabs(v[i] - ref[i]) > d)
+                    d = fabs(v[i] - ref[i]);
+            if (d > tol) {
+                printf("pool check: %d threads differ from 1 thread by %g\n", t, d);
+                bad = 1;
+            }
+            if (d > diff)
+                diff = d;
+        }
+        jacobi_pool_shutdown();
+        printf("pool check: %d calls, %s (max diff %g)\n", calls, bad ? "FAILED" : "ok", diff);
+        status = bad;
+        free(v);
+        free(ref);
+    }
+    if (opts.error)
+        printf("error vs direct: %g\n", tridiag_error(n, u, f));
 
     /* Write the results */
     if (fname)
@@ -237,5 +603,5 @@ int main(int argc, char** argv) {
 
     free(f);
     free(u);
-    return 0;
+    return status;
 }
\ No newline at end of file
@@ -8,6 +8,11 @@
 #include <sys/stat.h>
 
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "tridiag.h"
+#include "jacobi_sync.h"
+#include "jacobi_part.h"
 
 /* Shared memory structure for the arrays used in Jacobi method */
 typedef struct {
@@ -28,7 +33,19 @@ typedef struct {
     double h2;           // Square of the grid spacing
     int start;           // Start index for this thread
     int end;             // End index for this thread
-    pthread_barrier_t* barrier; // Synchronization barrier
+    jacobi_sync_t* sync;        // Barrier or neighbour sync between sweeps
+    jacobi_sweep_t half_sweep;  // Vectorized half-sweep kernel
+    jacobi_fused_t fused_sweep; // Fused two-sweep kernel (NULL for the split loop)
+    jacobi_sweep_res_t sweep_res; // Half-sweep that also accumulates the residual
+    jacobi_fused_res_t fused_res; // Fused kernel that also accumulates the residual
+    int num_threads;            // Number of threads sharing the partials
+    const jacobi_opts_t* opts;  // Residual check settings (NULL: fixed sweep count)
+    double* partials;           // Residual partials, 2 sets x 2 per thread (shared)
+    jacobi_stats_t stats;       // Sweeps done and last residual seen by this thread
+    int solver;                 // JACOBI_SOLVER_JACOBI, _WJACOBI, _RBGS, _SOR or _CHEBYSHEV
+    double omega;               // Relaxation weight of the wjacobi/rbgs/sor schemes
+    int* sep;                   // Separators of the direct solver (shared, num_threads+1)
+    int nparts;                 // Threads with a non-empty chunk (the first nparts)
 } thread_data_t;
 
 /* Create shared memory segment and map it to process address space */
@@ -108,7 +125,7 @@ void cleanup_shared_memory(shared_data_t shared) {
 /* Thread function for the Jacobi iteration */
 void* jacobi_worker(void* arg) {
     thread_data_t* data = (thread_data_t*)arg;
-    int i, sweep;
+    int sweep;
     
     // Extract data from the thread structure
     int start = data->start;
@@ -118,42 +135,196 @@ void* jacobi_worker(void* arg) {
     double* f = data->f;
     double h2 = data->h2;
     int nsweeps = data->nsweeps;
-    pthread_barrier_t* barrier = data->barrier;
-    
-    for (sweep = 0; sweep < nsweeps; sweep += 2) {
-        // First half-sweep: update utmp using values from u
-        for (i = start; i < end; ++i) {
-            utmp[i] = (u[i-1] + u[i+1] + h2*f[i])/2;
+    jacobi_sync_t* sync = data->sync;
+    int tid = data->thread_id;
+    jacobi_sweep_t half_sweep = data->half_sweep;
+    jacobi_fused_t fused_sweep = data->fused_sweep;
+    double* parts = data->partials;
+    double* norms = parts;
+    double total[2];
+    double halo[4];
+    double omega = data->omega;
+    int flags, check, color, done = 0;
+    
+    for (sweep = 0; sweep < nsweeps - 1 && !done; sweep += 2) {
+        // Every few sweeps the first half-sweep also measures the residual
+        check = jacobi_check_due(data->opts, sweep);
+        if (check) {
+            // Consecutive checks alternate between two sets of partials, so a
+            // fast thread never overwrites values a slow one is still reading
+            parts = data->partials
+                  + 2 * data->num_threads * (sweep / data->opts->check % 2);
+            norms = parts + 2 * data->thread_id;
+            norms[0] = norms[1] = 0;
         }
         
-        // Synchronize all threads before the second half-sweep
-        pthread_barrier_wait(barrier);
-        
-        // Second half-sweep: update u using values from utmp
-        for (i = start; i < end; ++i) {
-            u[i] = (utmp[i-1] + utmp[i+1] + h2*f[i])/2;
+        if (data->solver == JACOBI_SOLVER_WJACOBI) {
+            // Damped Jacobi, double-buffered like the split loop
+            jacobi_weighted_sweep(utmp, u, f, h2, omega, start, end,
+                                  check ? norms : NULL);
+            jacobi_sync_neighbors(sync, tid);
+            jacobi_weighted_sweep(u, utmp, f, h2, omega, start, end, NULL);
+        } else if (data->solver == JACOBI_SOLVER_CHEBYSHEV) {
+            // Chebyshev: the same double buffer, each array also holding the
+            // iterate before the one in the other array.  Every thread steps
+            // the weights itself and gets the same values
+            omega = jacobi_chebyshev_omega(data->n, sweep, omega);
+            jacobi_chebyshev_sweep(utmp, u, f, h2, omega, start, end,
+                                   check ? norms : NULL);
+            jacobi_sync_neighbors(sync, tid);
+            omega = jacobi_chebyshev_omega(data->n, sweep + 1, omega);
+            jacobi_chebyshev_sweep(u, utmp, f, h2, omega, start, end, NULL);
+        } else if (data->solver != JACOBI_SOLVER_JACOBI) {
+            // Red-black GS/SOR in place: measure u before anyone changes it,
+            // then red, black, red, black with a barrier between colors
+            if (check) {
+                jacobi_residual(u, f, h2, start, end, norms);
+                jacobi_sync_neighbors(sync, tid);
+            }
+            for (color = 0; color < 4; ++color) {
+                if (color > 0)
+                    jacobi_sync_neighbors(sync, tid);
+                jacobi_rb_sweep(u, f, h2, omega, start, end, color & 1);
+            }
+        } else if (fused_sweep != NULL) {
+            // Save the old values around this chunk before anyone overwrites them
+            flags = jacobi_halo(u, start, end, start == 1, end == data->n, halo);
+            jacobi_sync_neighbors(sync, tid);
+            
+            // Both sweeps in place: u^k -> u^{k+2}
+            if (check)
+                data->fused_res(u, f, h2, start, end, halo, flags, norms);
+            else
+                fused_sweep(u, f, h2, start, end, halo, flags);
+        } else {
+            // First half-sweep: update utmp using values from u
+            if (check)
+                data->sweep_res(utmp, u, f, h2, start, end, norms);
+            else
+                half_sweep(utmp, u, f, h2, start, end);
+            
+            // Wait for the neighbours before the second half-sweep
+            jacobi_sync_neighbors(sync, tid);
+            
+            // Second half-sweep: update u using values from utmp
+            half_sweep(u, utmp, f, h2, start, end);
         }
         
-        // Synchronize all threads before the next sweep
-        pthread_barrier_wait(barrier);
+        // Synchronize before the next sweep; summing the partials needs
+        // every thread, the sweep itself only the neighbours
+        if (check)
+            jacobi_sync_all(sync, tid);
+        else
+            jacobi_sync_neighbors(sync, tid);
+        
+        // All partials are in; every thread reduces them the same way and
+        // so takes the same decision without another barrier
+        if (check) {
+            jacobi_sum_norms(parts, data->num_threads, total);
+            done = jacobi_converged(data->opts, &data->stats, sweep, total,
+                                    1.0 / data->n);
+        }
     }
     
+    // If nsweeps is odd, do one extra sweep (into utmp and copied back to u
+    // for the Jacobi schemes)
+    if (nsweeps % 2 != 0 && !done) {
+        if (data->solver == JACOBI_SOLVER_RBGS || data->solver == JACOBI_SOLVER_SOR) {
+            jacobi_rb_sweep(u, f, h2, omega, start, end, 0);
+            jacobi_sync_neighbors(sync, tid);
+            jacobi_rb_sweep(u, f, h2, omega, start, end, 1);
+        } else {
+            if (data->solver == JACOBI_SOLVER_WJACOBI) {
+                jacobi_weighted_sweep(utmp, u, f, h2, omega, start, end, NULL);
+            } else if (data->solver == JACOBI_SOLVER_CHEBYSHEV) {
+                omega = jacobi_chebyshev_omega(data->n, sweep, omega);
+                jacobi_chebyshev_sweep(utmp, u, f, h2, omega, start, end, NULL);
+            } else {
+                half_sweep(utmp, u, f, h2, start, end);
+            }
+            jacobi_sync_neighbors(sync, tid);
+            memcpy(u + start, utmp + start, (end - start) * sizeof(double));
+        }
+        ++sweep;
+    }
+    data->stats.sweeps = sweep;
+    
+    return NULL;
+}
+
+/*
+ * Thread function for the direct solve (--solver direct): partitioned
+ * Thomas algorithm.  The last point of every chunk but the last is a
+ * separator; each thread solves the rest of its chunk with zero ends,
+ * thread 0 solves for the separators and then each thread adds the
+ * straight line between its two separators.
+ */
+void* direct_worker(void* arg) {
+    thread_data_t* data = (thread_data_t*)arg;
+    int p = data->thread_id;
+    int nparts = data->nparts;
+    double* u = data->u;
+    int lo = data->start;
+    int hi = (p == nparts - 1) ? data->end : data->end - 1;
+    double* y = data->partials;
+    int q;
+    
+    // Phase 1: independent solves, utmp as scratch (threads with an empty
+    // chunk only take part in the barriers)
+    if (p < nparts) {
+        tridiag_block(u, data->f, data->h2, lo, hi, data->utmp);
+        y[2*p] = u[lo];
+        y[2*p + 1] = u[hi - 1];
+        data->sep[p + 1] = hi;
+    }
+    if (p == 0)
+        data->sep[0] = 0;
+    jacobi_sync_all(data->sync, p);
+    
+    // Phase 2: the small system for the separators
+    if (p == 0 && nparts > 1) {
+        double* x = (double*) malloc((4*nparts + 2) * sizeof(double));
+        double* fsep = x + nparts + 1;
+        for (q = 0; q <= nparts; q++) {
+            fsep[q] = data->f[data->sep[q]];
+            x[q] = u[data->sep[q]];
+        }
+        tridiag_interface(nparts, data->sep, y, fsep, data->h2, x, fsep + nparts + 1);
+        for (q = 1; q < nparts; q++)
+            u[data->sep[q]] = x[q];
+        free(x);
+    }
+    jacobi_sync_all(data->sync, p);
+    
+    // Phase 3: add the homogeneous solution
+    if (p < nparts)
+        tridiag_correct(u, lo, hi, u[lo - 1], u[hi]);
+    
     return NULL;
 }
 
 /* 
  * Multi-threaded Jacobi iteration method with shared memory
- * num_threads specifies how many threads to use for the computation
+ * num_threads specifies how many threads to use for the computation.
+ * opts (may be NULL) turns on residual checks and early stopping;
+ * stats (may be NULL) gets the sweeps done and the last residual.
  */
-void jacobi_parallel_shared(int nsweeps, int n, double* u_orig, double* f_orig, int num_threads) {
+void jacobi_parallel_shared(int nsweeps, int n, double* u_orig, double* f_orig, int num_threads,
+                            const jacobi_opts_t* opts, jacobi_stats_t* stats) {
     int i;
     double h = 1.0 / n;
     double h2 = h*h;
     pthread_t* threads;
     thread_data_t* thread_data;
-    pthread_barrier_t barrier;
-    
-    // Initialize shared memory
+    jacobi_sync_t sync;
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
+    jacobi_fused_t fused_sweep = jacobi_use_fused() ? jacobi_fused_kernel() : NULL;
+    double* partials;
+    int* sep;
+    int* bounds;
+    int grain = jacobi_grain();
+    
+    // Initialize shared memory (mmap'd, so every array starts on a page)
     shared_data_t shared = init_shared_memory(n);
     
     // Copy input data to shared memory
@@ -173,17 +344,19 @@ void jacobi_parallel_shared(int nsweeps, int n, double* u_orig, double* f_orig,
     /* Allocate thread structures */
     threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
     thread_data = (thread_data_t*) malloc(num_threads * sizeof(thread_data_t));
+    partials = (double*) calloc(4 * num_threads, sizeof(double));
+    sep = (int*) malloc((num_threads + 1) * sizeof(int));
+    bounds = (int*) malloc((num_threads + 1) * sizeof(int));
     
-    /* Initialize the barrier for thread synchronization */
-    pthread_barrier_init(&barrier, NULL, num_threads);
+    /* Calculate the workload distribution: chunk edges on cache lines */
+    jacobi_partition(n, num_threads, grain, bounds);
+    jacobi_part_print(num_threads, bounds);
     
-    /* Calculate the workload distribution */
-    int points_per_thread = (n-1) / num_threads;
-    int remainder = (n-1) % num_threads;
+    /* Initialize the synchronization between sweeps (JACOBI_SYNC) */
+    jacobi_sync_init(&sync, num_threads, jacobi_sync_mode(),
+                     jacobi_part_min(num_threads, bounds));
     
     /* Create and launch the threads */
-    int start = 1; // Skip the first boundary point
-    
     for (i = 0; i < num_threads; i++) {
         // Calculate the range for this thread
         thread_data[i].thread_id = i;
@@ -193,26 +366,26 @@ void jacobi_parallel_shared(int nsweeps, int n, double* u_orig, double* f_orig,
         thread_data[i].utmp = shared.utmp;
         thread_data[i].f = shared.f;
         thread_data[i].h2 = h2;
-        thread_data[i].start = start;
-        
-        // Calculate how many points this thread will process
-        int points = points_per_thread;
-        if (i < remainder) {
-            points++; // Distribute the remainder among the first 'remainder' threads
-        }
-        
-        thread_data[i].end = start + points;
-        start = thread_data[i].end;
-        
-        // Note that we need to ensure that end <= n
-        if (thread_data[i].end > n) {
-            thread_data[i].end = n;
-        }
-        
-        thread_data[i].barrier = &barrier;
+        thread_data[i].start = bounds[i];
+        thread_data[i].end = bounds[i+1];
+        thread_data[i].sync = &sync;
+        thread_data[i].half_sweep = half_sweep;
+        thread_data[i].fused_sweep = fused_sweep;
+        thread_data[i].sweep_res = jacobi_sweep_res_kernel();
+        thread_data[i].fused_res = jacobi_fused_res_kernel();
+        thread_data[i].num_threads = num_threads;
+        thread_data[i].opts = opts;
+        thread_data[i].partials = partials;
+        memset(&thread_data[i].stats, 0, sizeof(jacobi_stats_t));
+        thread_data[i].solver = opts ? opts->solver : JACOBI_SOLVER_JACOBI;
+        thread_data[i].omega = opts ? jacobi_omega(opts, n) : 1.0;
+        thread_data[i].sep = sep;
+        thread_data[i].nparts = jacobi_part_count(n, num_threads, grain);
         
         // Create the thread
-        pthread_create(&threads[i], NULL, jacobi_worker, &thread_data[i]);
+        pthread_create(&threads[i], NULL,
+                       thread_data[i].solver == JACOBI_SOLVER_DIRECT ?
+                       direct_worker : jacobi_worker, &thread_data[i]);
     }
     
     /* Wait for all threads to complete */
@@ -223,15 +396,23 @@ void jacobi_parallel_shared(int nsweeps, int n, double* u_orig, double* f_orig,
     // Copy results back from shared memory
     memcpy(u_orig, shared.u, (n+1) * sizeof(double));
     
+    /* All threads saw the same residuals; report thread 0's */
+    if (stats)
+        *stats = thread_data[0].stats;
+    
     /* Clean up */
-    pthread_barrier_destroy(&barrier);
+    jacobi_sync_destroy(&sync);
+    free(partials);
+    free(sep);
+    free(bounds);
     free(threads);
     free(thread_data);
     cleanup_shared_memory(shared);
 }
 
 /* The main function - now modified to use shared memory */
-void jacobi(int nsweeps, int n, double* u, double* f) {
+void jacobi_tol(int nsweeps, int n, double* u, double* f,
+                const jacobi_opts_t* opts, jacobi_stats_t* stats) {
     // Default to 4 threads if not specified in the environment
     int num_threads = 4;
     
@@ -248,34 +429,80 @@ void jacobi(int nsweeps, int n, double* u, double* f) {
     char* use_shared_env = getenv("JACOBI_USE_SHARED");
     int use_shared = (use_shared_env != NULL && atoi(use_shared_env) > 0);
     
-    if (use_shared) {
+    // The other relaxation schemes only exist in the threaded version
+    if (use_shared || (opts != NULL && opts->solver != JACOBI_SOLVER_JACOBI)) {
         // Use parallel version with shared memory
-        jacobi_parallel_shared(nsweeps, n, u, f, num_threads);
+        jacobi_parallel_shared(nsweeps, n, u, f, num_threads, opts, stats);
     } else {
-        // Original implementation for when shared memory isn't needed
-        int i, sweep;
+        // Original implementation for when shared memory isn't needed;
+        // the residual checks of opts work here too
+        int sweep, done = 0;
         double h = 1.0 / n;
         double h2 = h*h;
-        double* utmp = (double*) malloc((n+1) * sizeof(double));
+        double norms[2];
+        double* utmp = NULL;
+        jacobi_sweep_t half_sweep = jacobi_kernel(n);
+        int fused = jacobi_use_fused();
 
-        /* Fill boundary conditions into utmp */
-        utmp[0] = u[0];
-        utmp[n] = u[n];
+        if (!fused || nsweeps % 2 != 0) {
+            utmp = jacobi_alloc(n+1);
 
-        for (sweep = 0; sweep < nsweeps; sweep += 2) {
-            /* Old data in u; new data in utmp */
-            for (i = 1; i < n; ++i)
-                utmp[i] = (u[i-1] + u[i+1] + h2*f[i])/2;
-            
-            /* Old data in utmp; new data in u */
-            for (i = 1; i < n; ++i)
-                u[i] = (utmp[i-1] + utmp[i+1] + h2*f[i])/2;
+            /* Fill boundary conditions into utmp */
+            utmp[0] = u[0];
+            utmp[n] = u[n];
+        }
+
+        if (fused) {
+            jacobi_fused_t fused_sweep = jacobi_fused_kernel();
+            jacobi_fused_res_t fused_res = jacobi_fused_res_kernel();
+            double halo[4];
+            int flags = jacobi_halo(u, 1, n, 1, 1, halo);
+
+            /* Old data in u; data two sweeps later in u */
+            for (sweep = 0; sweep < nsweeps - 1 && !done; sweep += 2) {
+                if (jacobi_check_due(opts, sweep)) {
+                    norms[0] = norms[1] = 0;
+                    fused_res(u, f, h2, 1, n, halo, flags, norms);
+                    done = jacobi_converged(opts, stats, sweep, norms, h);
+                } else {
+                    fused_sweep(u, f, h2, 1, n, halo, flags);
+                }
+            }
+        } else {
+            jacobi_sweep_res_t sweep_res = jacobi_sweep_res_kernel();
+
+            for (sweep = 0; sweep < nsweeps - 1 && !done; sweep += 2) {
+                /* Old data in u; new data in utmp */
+                if (jacobi_check_due(opts, sweep)) {
+                    norms[0] = norms[1] = 0;
+                    sweep_res(utmp, u, f, h2, 1, n, norms);
+                    done = jacobi_converged(opts, stats, sweep, norms, h);
+                } else {
+                    half_sweep(utmp, u, f, h2, 1, n);
+                }
+
+                /* Old data in utmp; new data in u */
+                half_sweep(u, utmp, f, h2, 1, n);
+            }
+        }
+
+        /* If nsweeps is odd, do one extra half-sweep */
+        if (nsweeps % 2 != 0 && !done) {
+            half_sweep(utmp, u, f, h2, 1, n);
+            memcpy(u+1, utmp+1, (n-1) * sizeof(double));
+            ++sweep;
         }
 
         free(utmp);
+        if (stats)
+            stats->sweeps = sweep;
     }
 }
 
+void jacobi(int nsweeps, int n, double* u, double* f) {
+    jacobi_tol(nsweeps, n, u, f, NULL, NULL);
+}
+
 void write_solution(int n, double* u, const char* fname) {
     int i;
     double h = 1.0 / n;
@@ -295,8 +522,17 @@ int main(int argc, char** argv) {
     char* fname;
     int num_threads = 8; // Default number of threads
     int use_shared = 1;  // Default to not using shared memory
+    jacobi_opts_t opts;
+    jacobi_stats_t stats = { 0, 0, 0, 0 };
 
     /* Process arguments */
+    jacobi_parse_opts(&argc, argv, &opts);
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_WJACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_RBGS) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_SOR) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CHEBYSHEV) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_DIRECT));
     n      = (argc > 1) ? atoi(argv[1]) : 100;
     nsteps = (argc > 2) ? atoi(argv[2]) : 100;
     fname  = (argc > 3) ? argv[3] : NULL;
@@ -322,26 +558,34 @@ int main(int argc, char** argv) {
     h = 1.0/n;
 
     /* Allocate and initialize arrays */
-    u = (double*) malloc((n+1) * sizeof(double));
-    f = (double*) malloc((n+1) * sizeof(double));
+    u = jacobi_alloc(n+1);
+    f = jacobi_alloc(n+1);
     memset(u, 0, (n+1) * sizeof(double));
     for (i = 0; i <= n; ++i)
         f[i] = i * h;
 
     /* Run the solver */
     get_time(&tstart);
-    jacobi(nsteps, n, u, f);
+    jacobi_tol(nsteps, n, u, f, &opts, &stats);
     get_time(&tend);
 
     /* Print results */    
     printf("n: %d\n"
            "nsteps: %d\n"
            "threads: %d\n"
+           "solver: %s\n"
            "shared memory: %s\n"
+           "kernel: %s\n"
+           "sync: %s\n"
            "Elapsed time: %g s\n", 
-           n, nsteps, num_threads, 
+           n, nsteps, num_threads, jacobi_solver_name(opts.solver),
            use_shared ? "enabled" : "disabled",
+           jacobi_kernel_name(jacobi_kernel(n)),
+           jacobi_sync_name(jacobi_sync_mode()),
            timespec_diff(tstart, tend));
+    jacobi_print_stats(&opts, &stats);
+    if (opts.error)
+        printf("error vs direct: %g\n", tridiag_error(n, u, f));
 
     /* Write the results */
     if (fname)
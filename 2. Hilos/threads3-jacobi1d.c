@@ -3,15 +3,30 @@
 #include <string.h>
 #include <pthread.h>
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "tridiag.h"
+#include "jacobi_sync.h"
+#include "jacobi_part.h"
 
 // Variables globales compartidas entre hilos
 int    n, nsteps;
 double *u, *f, *utmp;
 double h, h2;
 int num_threads;
+jacobi_sweep_t half_sweep;  // Kernel vectorizado elegido en tiempo de ejecución
+jacobi_fused_t fused_sweep; // Kernel de dos barridos fusionados (NULL: ciclo separado)
+jacobi_sweep_res_t sweep_res; // Medio barrido que además acumula el residuo
+jacobi_fused_res_t fused_res; // Kernel fusionado que además acumula el residuo
+jacobi_opts_t opts;         // --tol / --check / --solver / --omega
+double omega;               // Peso de relajación de wjacobi, rbgs y sor
+jacobi_stats_t stats;       // Barridos hechos y último residuo (lo escribe el hilo 0)
+double *partials;           // Residuo parcial de cada hilo: 2 juegos x 2 valores
+int *sep;                   // Separadores de la solución directa (num_threads+1)
+int nparts;                 // Hilos con bloque no vacío (los primeros nparts)
 
-// Barrera para sincronización de hilos
-pthread_barrier_t barrier;
+// Sincronización entre sweeps: barrera o solo vecinos (JACOBI_SYNC)
+jacobi_sync_t sync_hilos;
 
 // Estructura para enviar datos a cada hilo
 typedef struct {
@@ -27,35 +42,157 @@ void* jacobi_thread(void* arg) {
     int i;
     int sweep;
     // Ejecutamos nsweeps en grupos de dos (como en la versión secuencial)
-    for (sweep = 0; sweep < nsteps - 1; sweep += 2) {
-        // Primer sweep: calcular utmp basado en u
-        for (i = data->istart; i < data->iend; i++) {
-            utmp[i] = (u[i-1] + u[i+1] + h2 * f[i]) / 2.0;
+    double halo[4];
+    double total[2];
+    double *parts = partials, *norms = partials;
+    int flags, check, color, done = 0;
+    double w = omega;           // Peso de Chebyshev del sweep actual (propio de cada hilo)
+    jacobi_stats_t mis_stats = stats;
+    for (sweep = 0; sweep < nsteps - 1 && !done; sweep += 2) {
+        // Cada opts.check sweeps el primer medio barrido también mide el residuo.
+        // Los chequeos seguidos alternan entre dos juegos de parciales, para
+        // que un hilo rápido no pise valores que otro todavía está sumando
+        check = jacobi_check_due(&opts, sweep);
+        if (check) {
+            parts = partials + 2 * num_threads * (sweep / opts.check % 2);
+            norms = parts + 2 * tid;
+            norms[0] = norms[1] = 0;
         }
-        // Sincronización: esperar a que todos hayan escrito en utmp
-        pthread_barrier_wait(&barrier);
-        // Segundo sweep: calcular u basado en utmp
-        for (i = data->istart; i < data->iend; i++) {
-            u[i] = (utmp[i-1] + utmp[i+1] + h2 * f[i]) / 2.0;
+        if (opts.solver == JACOBI_SOLVER_WJACOBI) {
+            // Jacobi amortiguado, con dos arreglos como el ciclo separado
+            jacobi_weighted_sweep(utmp, u, f, h2, omega, data->istart, data->iend,
+                                  check ? norms : NULL);
+            jacobi_sync_neighbors(&sync_hilos, tid);
+            jacobi_weighted_sweep(u, utmp, f, h2, omega, data->istart, data->iend, NULL);
+        } else if (opts.solver == JACOBI_SOLVER_CHEBYSHEV) {
+            // Chebyshev: mismo doble arreglo, cada uno guarda además la
+            // iteración anterior a la del otro.  Cada hilo calcula los pesos
+            // por su cuenta y obtiene los mismos valores
+            w = jacobi_chebyshev_omega(n, sweep, w);
+            jacobi_chebyshev_sweep(utmp, u, f, h2, w, data->istart, data->iend,
+                                   check ? norms : NULL);
+            jacobi_sync_neighbors(&sync_hilos, tid);
+            w = jacobi_chebyshev_omega(n, sweep + 1, w);
+            jacobi_chebyshev_sweep(u, utmp, f, h2, w, data->istart, data->iend, NULL);
+        } else if (opts.solver != JACOBI_SOLVER_JACOBI) {
+            // Gauss-Seidel / SOR rojo-negro en el mismo arreglo: medir u antes
+            // de que nadie lo cambie y luego rojo, negro, rojo, negro con una
+            // barrera entre colores
+            if (check) {
+                jacobi_residual(u, f, h2, data->istart, data->iend, norms);
+                jacobi_sync_neighbors(&sync_hilos, tid);
+            }
+            for (color = 0; color < 4; ++color) {
+                if (color > 0)
+                    jacobi_sync_neighbors(&sync_hilos, tid);
+                jacobi_rb_sweep(u, f, h2, omega, data->istart, data->iend, color & 1);
+            }
+        } else if (fused_sweep != NULL) {
+            // Guardar los valores vecinos antes de que otro hilo los sobrescriba
+            flags = jacobi_halo(u, data->istart, data->iend,
+                                data->istart == 1, data->iend == n, halo);
+            jacobi_sync_neighbors(&sync_hilos, tid);
+            // Los dos sweeps en el mismo arreglo: u^k -> u^{k+2}
+            if (check)
+                fused_res(u, f, h2, data->istart, data->iend, halo, flags, norms);
+            else
+                fused_sweep(u, f, h2, data->istart, data->iend, halo, flags);
+        } else {
+            // Primer sweep: calcular utmp basado en u
+            if (check)
+                sweep_res(utmp, u, f, h2, data->istart, data->iend, norms);
+            else
+                half_sweep(utmp, u, f, h2, data->istart, data->iend);
+            // Sincronización: esperar a que los vecinos hayan escrito en utmp
+            jacobi_sync_neighbors(&sync_hilos, tid);
+            // Segundo sweep: calcular u basado en utmp
+            half_sweep(u, utmp, f, h2, data->istart, data->iend);
+        }
+        // Sincronización: para sumar los parciales hacen falta todos los
+        // hilos, para el próximo sweep alcanza con los vecinos
+        if (check)
+            jacobi_sync_all(&sync_hilos, tid);
+        else
+            jacobi_sync_neighbors(&sync_hilos, tid);
+        // Todos suman los parciales en el mismo orden y toman la misma decisión
+        if (check) {
+            jacobi_sum_norms(parts, num_threads, total);
+            done = jacobi_converged(&opts, &mis_stats, sweep, total, h);
         }
-        // Sincronización: esperar a que todos hayan escrito en u
-        pthread_barrier_wait(&barrier);
     }
     // Si nsteps es impar, se realiza un sweep extra
-    if(nsteps % 2 != 0) {
-        for (i = data->istart; i < data->iend; i++) {
-            utmp[i] = (u[i-1] + u[i+1] + h2 * f[i]) / 2.0;
+    if(nsteps % 2 != 0 && !done && (opts.solver == JACOBI_SOLVER_RBGS ||
+                                     opts.solver == JACOBI_SOLVER_SOR)) {
+        // Rojo-negro: un color, barrera y el otro, sin arreglo auxiliar
+        jacobi_rb_sweep(u, f, h2, omega, data->istart, data->iend, 0);
+        jacobi_sync_neighbors(&sync_hilos, tid);
+        jacobi_rb_sweep(u, f, h2, omega, data->istart, data->iend, 1);
+        jacobi_sync_neighbors(&sync_hilos, tid);
+        sweep++;
+    } else if(nsteps % 2 != 0 && !done) {
+        if (opts.solver == JACOBI_SOLVER_WJACOBI) {
+            jacobi_weighted_sweep(utmp, u, f, h2, omega, data->istart, data->iend, NULL);
+        } else if (opts.solver == JACOBI_SOLVER_CHEBYSHEV) {
+            w = jacobi_chebyshev_omega(n, sweep, w);
+            jacobi_chebyshev_sweep(utmp, u, f, h2, w, data->istart, data->iend, NULL);
+        } else {
+            half_sweep(utmp, u, f, h2, data->istart, data->iend);
         }
-        pthread_barrier_wait(&barrier);
+        jacobi_sync_neighbors(&sync_hilos, tid);
         // Copiamos la frontera calculada en utmp de vuelta a u
         for (i = data->istart; i < data->iend; i++) {
             u[i] = utmp[i];
         }
-        pthread_barrier_wait(&barrier);
+        jacobi_sync_neighbors(&sync_hilos, tid);
+        sweep++;
+    }
+    if (tid == 0) {
+        mis_stats.sweeps = sweep;
+        stats = mis_stats;
     }
     pthread_exit(NULL);
 }
 
+// Solución directa (--solver direct): Thomas particionado.  El último punto
+// del bloque de cada hilo (menos el del último) es un separador; cada hilo
+// resuelve el resto de su bloque con extremos en cero, el hilo 0 resuelve
+// el sistema chico de los separadores y al final cada hilo suma la recta
+// entre sus dos separadores
+void* direct_thread(void* arg) {
+    thread_data_t *data = (thread_data_t*) arg;
+    int tid = data->tid;
+    int lo = data->istart;
+    int hi = (tid == nparts - 1) ? data->iend : data->iend - 1;
+    int q;
+    // Fase 1: soluciones independientes, utmp como espacio de trabajo (los
+    // hilos con bloque vacío solo participan de las barreras)
+    if (tid < nparts) {
+        tridiag_block(u, f, h2, lo, hi, utmp);
+        partials[2*tid] = u[lo];
+        partials[2*tid + 1] = u[hi - 1];
+        sep[tid + 1] = hi;
+    }
+    jacobi_sync_all(&sync_hilos, tid);
+    // Fase 2: el hilo 0 calcula u en los separadores
+    if (tid == 0 && nparts > 1) {
+        double *x = (double*) malloc((4*nparts + 2) * sizeof(double));
+        double *fsep = x + nparts + 1;
+        for (q = 0; q <= nparts; q++) {
+            fsep[q] = f[sep[q]];
+            x[q] = u[sep[q]];
+        }
+        tridiag_interface(nparts, sep, partials, fsep, h2, x, fsep + nparts + 1);
+        for (q = 1; q < nparts; q++)
+            u[sep[q]] = x[q];
+        free(x);
+    }
+    jacobi_sync_all(&sync_hilos, tid);
+    // Fase 3: sumar la solución homogénea
+    if (tid < nparts)
+        tridiag_correct(u, lo, hi, u[lo - 1], u[hi]);
+    pthread_exit(NULL);
+}
+
 // Función para escribir la solución en un archivo
 void write_solution(int n, double* u, const char* fname) {
     int i;
@@ -78,17 +215,33 @@ int main(int argc, char** argv) {
 
     // Procesar argumentos
     // Uso: ./jacobi_pthread [n] [nsteps] [fname-opcional] [num_threads]
+    // (--tol X, --check K, --solver S, --omega W y --error se pueden poner en cualquier lugar y se quitan de argv)
+    jacobi_parse_opts(&argc, argv, &opts);
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_WJACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_RBGS) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_SOR) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CHEBYSHEV) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_DIRECT));
     n         = (argc > 1) ? atoi(argv[1]) : 100;
     nsteps    = (argc > 2) ? atoi(argv[2]) : 100;
     num_threads = (argc > 3) ? atoi(argv[3]) : 2;
     fname     = (argc > 4) ? argv[4] : NULL;
     h         = 1.0 / n;
     h2        = h * h;
+    omega     = jacobi_omega(&opts, n);
+    half_sweep = jacobi_kernel(n);
+    fused_sweep = jacobi_use_fused() ? jacobi_fused_kernel() : NULL;
+    sweep_res = jacobi_sweep_res_kernel();
+    fused_res = jacobi_fused_res_kernel();
+    partials = (double*) calloc(4 * num_threads, sizeof(double));
+    sep = (int*) calloc(num_threads + 1, sizeof(int));
     
     // Asignar e inicializar arreglos
-    u    = (double*) malloc((n+1) * sizeof(double));
-    f    = (double*) malloc((n+1) * sizeof(double));
-    utmp = (double*) malloc((n+1) * sizeof(double));
+    // (alineados a línea de caché, como los bordes de los bloques)
+    u    = jacobi_alloc(n+1);
+    f    = jacobi_alloc(n+1);
+    utmp = jacobi_alloc(n+1);
     if(u == NULL || f == NULL || utmp == NULL) {
         fprintf(stderr, "Error al asignar memoria\n");
         exit(EXIT_FAILURE);
@@ -102,9 +255,6 @@ int main(int argc, char** argv) {
     utmp[0] = u[0];
     utmp[n] = u[n];
 
-    // Inicializar la barrera con el número de hilos
-    pthread_barrier_init(&barrier, NULL, num_threads);
-
     // Reservar memoria para hilos y datos
     threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
     thread_data = (thread_data_t*) malloc(num_threads * sizeof(thread_data_t));
@@ -114,10 +264,16 @@ int main(int argc, char** argv) {
     }
     
     // Calcular el tamaño del trabajo de cada hilo
-    // Se dividen los índices [1, n) entre los hilos
-    int chunk = (n - 1) / num_threads;
-    int remainder = (n - 1) % num_threads;
-    int start = 1;
+    // Se dividen los índices [1, n) entre los hilos con los bordes de cada
+    // bloque en un múltiplo de la línea de caché (JACOBI_GRAIN da el mínimo)
+    int grain = jacobi_grain();
+    int *bounds = (int*) malloc((num_threads + 1) * sizeof(int));
+    jacobi_partition(n, num_threads, grain, bounds);
+    nparts = jacobi_part_count(n, num_threads, grain);
+
+    // Inicializar la sincronización con el número de hilos
+    jacobi_sync_init(&sync_hilos, num_threads, jacobi_sync_mode(),
+                     jacobi_part_min(num_threads, bounds));
     
     // Iniciar la medición del tiempo
     get_time(&tstart);
@@ -125,12 +281,11 @@ int main(int argc, char** argv) {
     // Crear hilos
     for (i = 0; i < num_threads; i++) {
         thread_data[i].tid = i;
-        thread_data[i].istart = start;
-        // Para distribuir el remainder
-        int extra = (i < remainder) ? 1 : 0;
-        thread_data[i].iend = start + chunk + extra;
-        start = thread_data[i].iend;
-        if(pthread_create(&threads[i], NULL, jacobi_thread, (void*) &thread_data[i]) != 0) {
+        thread_data[i].istart = bounds[i];
+        thread_data[i].iend = bounds[i+1];
+        if(pthread_create(&threads[i], NULL,
+                          opts.solver == JACOBI_SOLVER_DIRECT ? direct_thread : jacobi_thread,
+                          (void*) &thread_data[i]) != 0) {
             fprintf(stderr, "Error al crear el hilo %d\n", i);
             exit(EXIT_FAILURE);
         }
@@ -143,8 +298,14 @@ int main(int argc, char** argv) {
     
     // Finalizar la medición del tiempo
     get_time(&tend);
-    printf("n: %d\nnsteps: %d\nnum_threads: %d\nElapsed time: %g s\n", 
-           n, nsteps, num_threads, timespec_diff(tstart, tend));
+    printf("n: %d\nnsteps: %d\nnum_threads: %d\nsolver: %s\nsweep: %s\nkernel: %s\nsync: %s\nElapsed time: %g s\n", 
+           n, nsteps, num_threads, jacobi_solver_name(opts.solver), fused_sweep ? "fused" : "split",
+           jacobi_kernel_name(half_sweep), jacobi_sync_name(sync_hilos.mode),
+           timespec_diff(tstart, tend));
+    jacobi_part_print(num_threads, bounds);
+    jacobi_print_stats(&opts, &stats);
+    if (opts.error)
+        printf("error vs direct: %g\n", tridiag_error(n, u, f));
     
     // Escribir la solución si se indicó un archivo
     if (fname)
@@ -156,7 +317,10 @@ int main(int argc, char** argv) {
     free(utmp);
     free(threads);
     free(thread_data);
-    pthread_barrier_destroy(&barrier);
+    free(partials);
+    free(sep);
+    free(bounds);
+    jacobi_sync_destroy(&sync_hilos);
     
     return 0;
 }
\ No newline at end of file
@@ -6,57 +6,347 @@
 #include <sched.h>
 #include <unistd.h>
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "tridiag.h"
+#include "jacobi_sync.h"
+#include "jacobi_part.h"
+#include "jacobi_numa.h"
+#include "jacobi_topo.h"
 
 // Variables globales compartidas entre hilos
 int    n, nsteps;
 double *u, *f, *utmp;
 double h, h2;
 int num_threads;
+jacobi_sweep_t half_sweep;  // Kernel vectorizado elegido en tiempo de ejecución
+jacobi_fused_t fused_sweep; // Kernel de dos barridos fusionados (NULL: ciclo separado)
+jacobi_sweep_res_t sweep_res; // Medio barrido que además acumula el residuo
+jacobi_fused_res_t fused_res; // Kernel fusionado que además acumula el residuo
+jacobi_opts_t opts;         // --tol / --check / --solver / --omega
+double omega;               // Peso de relajación de wjacobi, rbgs y sor
+jacobi_stats_t stats;       // Barridos hechos y último residuo (lo escribe el hilo 0)
+double *partials;           // Residuo parcial de cada hilo: 2 juegos x 2 valores
+int *sep;                   // Separadores de la solución directa (num_threads+1)
+int nparts;                 // Hilos con bloque no vacío (los primeros nparts)
 
-// Barrera para sincronización de hilos
-pthread_barrier_t barrier;
+// Sincronización entre sweeps: barrera o solo vecinos (JACOBI_SYNC)
+jacobi_sync_t sync_hilos;
+
+// Reparto de [1, n) entre los hilos.  Con JACOBI_BALANCE cada tantos sweeps
+// se mide cuánto tardó cada hilo en calcular su bloque y los bordes se
+// mueven hacia los hilos más rápidos (núcleos de distinto tipo, vecinos
+// ruidosos en un nodo compartido)
+int grain;                  // Mínimo de puntos por bloque (JACOBI_GRAIN)
+int *bounds;                // Bordes de los bloques (num_threads+1); al final, los últimos usados
+int balance_window;         // Sweeps entre rebalanceos (0: reparto fijo)
+double *busy;               // Tiempo de cómputo de cada hilo en la ventana: 2 juegos
+
+// Ubicación de los arreglos en los nodos NUMA (JACOBI_NUMA)
+int numa_policy;
+timing_t tinit;             // Fin de la inicialización (lo toma el hilo 0)
 
 // Estructura para enviar datos a cada hilo
 typedef struct {
     int tid;      // ID del hilo
     int istart;   // índice de inicio de la porción a computar (excluyendo 0)
     int iend;     // índice final (exclusivo) de la porción a computar
+    int node;     // nodo NUMA del CPU donde corre el hilo
 } thread_data_t;
 
+// Rango de u, utmp y f que inicializa cada hilo: su porción, más el punto
+// de frontera 0 para el primero y n para el último
+static void init_range(thread_data_t* data, int* lo, int* hi) {
+    *lo = (data->tid == 0) ? 0 : data->istart;
+    *hi = (data->tid == num_threads - 1) ? n + 1 : data->iend;
+}
+
+// Primer contacto: cada hilo escribe su propia porción de u, utmp y f antes
+// de empezar, así las páginas quedan en el nodo del CPU que las va a barrer
+// (con bind se fijan además a ese nodo antes de tocarlas; la página de un
+// borde es del rango del vecino, así que nadie escribe hasta que todos
+// fijaron sus páginas).  Termina con una barrera y el hilo 0 anota el
+// tiempo, para medir solo los sweeps
+static void init_chunk(thread_data_t* data) {
+    int i, lo, hi;
+    size_t first, last;
+    data->node = jacobi_numa_current_node();
+    init_range(data, &lo, &hi);
+    if (numa_policy == JACOBI_NUMA_BIND) {
+        jacobi_numa_pages(n + 1, lo, hi, &first, &last);
+        jacobi_numa_bind(u, first, last, data->node);
+        jacobi_numa_bind(utmp, first, last, data->node);
+        jacobi_numa_bind(f, first, last, data->node);
+        jacobi_sync_all(&sync_hilos, data->tid);
+    }
+    for (i = lo; i < hi; i++) {
+        u[i] = 0;
+        utmp[i] = 0;
+        f[i] = i * h;
+    }
+    jacobi_sync_all(&sync_hilos, data->tid);
+    if (data->tid == 0)
+        get_time(&tinit);
+}
+
+// Reloj de pared en segundos, para medir el tiempo de cómputo de cada hilo
+static double ahora(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Espera a los vecinos (o a todos) y, con el balanceo activo, suma a
+// *ocupado el tiempo de cómputo desde la espera anterior: lo que se espera
+// a los demás no cuenta
+static void esperar(int tid, int todos, double* ocupado, double* marca) {
+    if (balance_window > 0)
+        *ocupado += ahora() - *marca;
+    if (todos)
+        jacobi_sync_all(&sync_hilos, tid);
+    else
+        jacobi_sync_neighbors(&sync_hilos, tid);
+    if (balance_window > 0)
+        *marca = ahora();
+}
+
+// Nuevos bordes a partir de los tiempos de la ventana.  Cada hilo los
+// calcula por su cuenta con los mismos tiempos y obtiene los mismos bordes;
+// el hilo 0 además los deja en bounds y anota la decisión
+static void rebalancear(thread_data_t* data, int* mis_bordes,
+                        const double* cargas, int sweep) {
+    int k;
+    double lento = 0, rapido = cargas[0];
+    if (data->tid >= nparts ||
+        !jacobi_part_balance(n, nparts, grain, cargas, mis_bordes))
+        return;
+    data->istart = mis_bordes[data->tid];
+    data->iend = mis_bordes[data->tid + 1];
+    if (data->tid == 0) {
+        for (k = 0; k < nparts; k++) {
+            if (cargas[k] > lento) lento = cargas[k];
+            if (cargas[k] < rapido) rapido = cargas[k];
+        }
+        memcpy(bounds, mis_bordes, (num_threads + 1) * sizeof(int));
+        fprintf(stderr, "rebalanceo en el sweep %d (ocupado máx/mín %.3f): bloques", sweep, lento / rapido);
+        for (k = 0; k < num_threads; k++)
+            fprintf(stderr, " %d", mis_bordes[k+1] - mis_bordes[k]);
+        fprintf(stderr, "\n");
+    }
+}
+
 // Función que realizan los hilos para computar la iteración de Jacobi
 void* jacobi_thread(void* arg) {
     thread_data_t *data = (thread_data_t*) arg;
+    int tid = data->tid;
     int i, sweep;
     // Ejecutamos nsweeps en grupos de dos (como en la versión secuencial)
-    for (sweep = 0; sweep < nsteps - 1; sweep += 2) {
-        // Primer sweep: calcular utmp basado en u
-        for (i = data->istart; i < data->iend; i++) {
-            utmp[i] = (u[i-1] + u[i+1] + h2 * f[i]) / 2.0;
+    double halo[4];
+    double total[2];
+    double *parts = partials, *norms = partials;
+    int flags, check, color, done = 0;
+    double w = omega;           // Peso de Chebyshev del sweep actual (propio de cada hilo)
+    jacobi_stats_t mis_stats = stats;
+    int rebalance = 0;
+    double ocupado = 0, marca = 0;  // Cómputo en la ventana de balanceo
+    double *cargas = busy;
+    int *mis_bordes = NULL;
+    init_chunk(data);
+    if (balance_window > 0) {
+        mis_bordes = (int*) malloc((num_threads + 1) * sizeof(int));
+        memcpy(mis_bordes, bounds, (num_threads + 1) * sizeof(int));
+        marca = ahora();
+    }
+    for (sweep = 0; sweep < nsteps - 1 && !done; sweep += 2) {
+        // Cada opts.check sweeps el primer medio barrido también mide el residuo.
+        // Los chequeos seguidos alternan entre dos juegos de parciales, para
+        // que un hilo rápido no pise valores que otro todavía está sumando
+        check = jacobi_check_due(&opts, sweep);
+        if (check) {
+            parts = partials + 2 * num_threads * (sweep / opts.check % 2);
+            norms = parts + 2 * tid;
+            norms[0] = norms[1] = 0;
         }
-        // Sincronización: esperar a que todos hayan escrito en utmp
-        pthread_barrier_wait(&barrier);
-        // Segundo sweep: calcular u basado en utmp
-        for (i = data->istart; i < data->iend; i++) {
-            u[i] = (utmp[i-1] + utmp[i+1] + h2 * f[i]) / 2.0;
+        if (opts.solver == JACOBI_SOLVER_WJACOBI) {
+            // Jacobi amortiguado, con dos arreglos como el ciclo separado
+            jacobi_weighted_sweep(utmp, u, f, h2, omega, data->istart, data->iend,
+                                  check ? norms : NULL);
+            esperar(tid, 0, &ocupado, &marca);
+            jacobi_weighted_sweep(u, utmp, f, h2, omega, data->istart, data->iend, NULL);
+        } else if (opts.solver == JACOBI_SOLVER_CHEBYSHEV) {
+            // Chebyshev: mismo doble arreglo, cada uno guarda además la
+            // iteración anterior a la del otro.  Cada hilo calcula los pesos
+            // por su cuenta y obtiene los mismos valores
+            w = jacobi_chebyshev_omega(n, sweep, w);
+            jacobi_chebyshev_sweep(utmp, u, f, h2, w, data->istart, data->iend,
+                                   check ? norms : NULL);
+            esperar(tid, 0, &ocupado, &marca);
+            w = jacobi_chebyshev_omega(n, sweep + 1, w);
+            jacobi_chebyshev_sweep(u, utmp, f, h2, w, data->istart, data->iend, NULL);
+        } else if (opts.solver != JACOBI_SOLVER_JACOBI) {
+            // Gauss-Seidel / SOR rojo-negro en el mismo arreglo: medir u antes
+            // de que nadie lo cambie y luego rojo, negro, rojo, negro con una
+            // barrera entre colores
+            if (check) {
+                jacobi_residual(u, f, h2, data->istart, data->iend, norms);
+                esperar(tid, 0, &ocupado, &marca);
+            }
+            for (color = 0; color < 4; ++color) {
+                if (color > 0)
+                    esperar(tid, 0, &ocupado, &marca);
+                jacobi_rb_sweep(u, f, h2, omega, data->istart, data->iend, color & 1);
+            }
+        } else if (fused_sweep != NULL) {
+            // Guardar los valores vecinos antes de que otro hilo los sobrescriba
+            flags = jacobi_halo(u, data->istart, data->iend,
+                                data->istart == 1, data->iend == n, halo);
+            esperar(tid, 0, &ocupado, &marca);
+            // Los dos sweeps en el mismo arreglo: u^k -> u^{k+2}
+            if (check)
+                fused_res(u, f, h2, data->istart, data->iend, halo, flags, norms);
+            else
+                fused_sweep(u, f, h2, data->istart, data->iend, halo, flags);
+        } else {
+            // Primer sweep: calcular utmp basado en u
+            if (check)
+                sweep_res(utmp, u, f, h2, data->istart, data->iend, norms);
+            else
+                half_sweep(utmp, u, f, h2, data->istart, data->iend);
+            // Sincronización: esperar a que los vecinos hayan escrito en utmp
+            esperar(tid, 0, &ocupado, &marca);
+            // Segundo sweep: calcular u basado en utmp
+            half_sweep(u, utmp, f, h2, data->istart, data->iend);
+        }
+        // Al final de cada ventana se publica el tiempo de cómputo; como con
+        // los parciales, ventanas seguidas alternan entre dos juegos
+        rebalance = balance_window > 0 && (sweep + 2) % balance_window == 0 &&
+                    sweep + 2 < nsteps - 1;
+        if (rebalance) {
+            cargas = busy + num_threads * ((sweep + 2) / balance_window % 2);
+            cargas[tid] = ocupado;
+        }
+        // Sincronización: para sumar los parciales o los tiempos hacen falta
+        // todos los hilos, para el próximo sweep alcanza con los vecinos
+        esperar(tid, check || rebalance, &ocupado, &marca);
+        // Todos suman los parciales en el mismo orden y toman la misma decisión
+        if (check) {
+            jacobi_sum_norms(parts, num_threads, total);
+            done = jacobi_converged(&opts, &mis_stats, sweep, total, h);
+        }
+        if (rebalance && !done) {
+            rebalancear(data, mis_bordes, cargas, sweep + 2);
+            ocupado = 0;
+            marca = ahora();
         }
-        // Sincronización: esperar a que todos hayan escrito en u
-        pthread_barrier_wait(&barrier);
     }
     // Si nsteps es impar, se realiza un sweep extra
-    if(nsteps % 2 != 0) {
-        for (i = data->istart; i < data->iend; i++) {
-            utmp[i] = (u[i-1] + u[i+1] + h2 * f[i]) / 2.0;
+    if(nsteps % 2 != 0 && !done && (opts.solver == JACOBI_SOLVER_RBGS ||
+                                     opts.solver == JACOBI_SOLVER_SOR)) {
+        // Rojo-negro: un color, barrera y el otro, sin arreglo auxiliar
+        jacobi_rb_sweep(u, f, h2, omega, data->istart, data->iend, 0);
+        esperar(tid, 0, &ocupado, &marca);
+        jacobi_rb_sweep(u, f, h2, omega, data->istart, data->iend, 1);
+        esperar(tid, 0, &ocupado, &marca);
+        sweep++;
+    } else if(nsteps % 2 != 0 && !done) {
+        if (opts.solver == JACOBI_SOLVER_WJACOBI) {
+            jacobi_weighted_sweep(utmp, u, f, h2, omega, data->istart, data->iend, NULL);
+        } else if (opts.solver == JACOBI_SOLVER_CHEBYSHEV) {
+            w = jacobi_chebyshev_omega(n, sweep, w);
+            jacobi_chebyshev_sweep(utmp, u, f, h2, w, data->istart, data->iend, NULL);
+        } else {
+            half_sweep(utmp, u, f, h2, data->istart, data->iend);
         }
-        pthread_barrier_wait(&barrier);
+        esperar(tid, 0, &ocupado, &marca);
         // Copiar la frontera calculada en utmp de vuelta a u
         for (i = data->istart; i < data->iend; i++) {
             u[i] = utmp[i];
         }
-        pthread_barrier_wait(&barrier);
+        esperar(tid, 0, &ocupado, &marca);
+        sweep++;
+    }
+    if (tid == 0) {
+        mis_stats.sweeps = sweep;
+        stats = mis_stats;
     }
+    free(mis_bordes);
     pthread_exit(NULL);
 }
 
+// Solución directa (--solver direct): Thomas particionado.  El último punto
+// del bloque de cada hilo (menos el del último) es un separador; cada hilo
+// resuelve el resto de su bloque con extremos en cero, el hilo 0 resuelve
+// el sistema chico de los separadores y al final cada hilo suma la recta
+// entre sus dos separadores
+void* direct_thread(void* arg) {
+    thread_data_t *data = (thread_data_t*) arg;
+    int tid = data->tid;
+    int lo = data->istart;
+    int hi = (tid == nparts - 1) ? data->iend : data->iend - 1;
+    int q;
+    init_chunk(data);
+    // Fase 1: soluciones independientes, utmp como espacio de trabajo (los
+    // hilos con bloque vacío solo participan de las barreras)
+    if (tid < nparts) {
+        tridiag_block(u, f, h2, lo, hi, utmp);
+        partials[2*tid] = u[lo];
+        partials[2*tid + 1] = u[hi - 1];
+        sep[tid + 1] = hi;
+    }
+    jacobi_sync_all(&sync_hilos, tid);
+    // Fase 2: el hilo 0 calcula u en los separadores
+    if (tid == 0 && nparts > 1) {
+        double *x = (double*) malloc((4*nparts + 2) * sizeof(double));
+        double *fsep = x + nparts + 1;
+        for (q = 0; q <= nparts; q++) {
+            fsep[q] = f[sep[q]];
+            x[q] = u[sep[q]];
+        }
+        tridiag_interface(nparts, sep, partials, fsep, h2, x, fsep + nparts + 1);
+        for (q = 1; q < nparts; q++)
+            u[sep[q]] = x[q];
+        free(x);
+    }
+    jacobi_sync_all(&sync_hilos, tid);
+    // Fase 3: sumar la solución homogénea
+    if (tid < nparts)
+        tridiag_correct(u, lo, hi, u[lo - 1], u[hi]);
+    pthread_exit(NULL);
+}
+
+// Páginas de u, utmp y f residentes en cada nodo y cuántas de ellas están
+// en el nodo del hilo que las barre.  El tráfico por nodo se estima como lo
+// residente por el número de sweeps, ya que cada sweep recorre los arreglos
+void write_numa_report(thread_data_t* thread_data, int sweeps) {
+    long per_node[JACOBI_NUMA_MAX_NODES] = { 0 };
+    long local = 0, total = 0, mine[JACOBI_NUMA_MAX_NODES];
+    double mb = (double) sysconf(_SC_PAGESIZE) / (1 << 20);
+    int t, k, lo, hi, nodes = jacobi_numa_nodes();
+    size_t first, last;
+    printf("numa: %s (%d nodos)\n", jacobi_numa_name(numa_policy), nodes);
+    for (t = 0; t < num_threads; t++) {
+        memset(mine, 0, sizeof(mine));
+        init_range(&thread_data[t], &lo, &hi);
+        jacobi_numa_pages(n + 1, lo, hi, &first, &last);
+        if (jacobi_numa_count(u, first, last, mine) != 0 ||
+            jacobi_numa_count(utmp, first, last, mine) != 0 ||
+            jacobi_numa_count(f, first, last, mine) != 0) {
+            printf("numa: el kernel no informa la ubicación de las páginas\n");
+            return;
+        }
+        for (k = 0; k < JACOBI_NUMA_MAX_NODES; k++) {
+            per_node[k] += mine[k];
+            total += mine[k];
+        }
+        local += mine[thread_data[t].node];
+    }
+    for (k = 0; k < nodes; k++)
+        printf("nodo %d: %ld páginas (%.1f MB), tráfico estimado %.1f MB\n",
+               k, per_node[k], per_node[k] * mb, per_node[k] * mb * sweeps);
+    printf("páginas locales: %ld de %ld (%.1f%%)\n", local, total,
+           total ? 100.0 * local / total : 0.0);
+}
+
 // Función para escribir la solución en un archivo
 void write_solution(int n, double* u, const char* fname) {
     int i;
@@ -76,73 +366,101 @@ int main(int argc, char** argv) {
     pthread_t *threads;
     thread_data_t *thread_data;
     timing_t tstart, tend;
+    pthread_attr_t attr;
+    int place, *cpus;
 
     // Procesar argumentos  
     // Uso: ./jacobi_pthread [n] [nsteps] [num_threads] [fname-opcional]
+    // (--tol X, --check K, --solver S, --omega W y --error se pueden poner en cualquier lugar y se quitan de argv)
+    jacobi_parse_opts(&argc, argv, &opts);
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_WJACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_RBGS) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_SOR) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CHEBYSHEV) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_DIRECT));
     n         = (argc > 1) ? atoi(argv[1]) : 100;
     nsteps    = (argc > 2) ? atoi(argv[2]) : 100;
     num_threads = (argc > 3) ? atoi(argv[3]) : 2;
     fname     = (argc > 4) ? argv[4] : NULL;
     h         = 1.0 / n;
     h2        = h * h;
+    omega     = jacobi_omega(&opts, n);
+    half_sweep = jacobi_kernel(n);
+    fused_sweep = jacobi_use_fused() ? jacobi_fused_kernel() : NULL;
+    sweep_res = jacobi_sweep_res_kernel();
+    fused_res = jacobi_fused_res_kernel();
+    partials = (double*) calloc(4 * num_threads, sizeof(double));
+    sep = (int*) calloc(num_threads + 1, sizeof(int));
     
-    // Asignar e inicializar arreglos
-    u    = (double*) malloc((n+1) * sizeof(double));
-    f    = (double*) malloc((n+1) * sizeof(double));
-    utmp = (double*) malloc((n+1) * sizeof(double));
+    // Asignar arreglos sin tocarlos: cada hilo inicializa su porción (primer
+    // contacto).  Las condiciones de frontera u[0] = u[n] = 0 las escriben
+    // el primer y el último hilo
+    numa_policy = jacobi_numa_policy();
+    u    = jacobi_numa_alloc(n+1, numa_policy);
+    f    = jacobi_numa_alloc(n+1, numa_policy);
+    utmp = jacobi_numa_alloc(n+1, numa_policy);
     if(u == NULL || f == NULL || utmp == NULL) {
         fprintf(stderr, "Error al asignar memoria\n");
         exit(EXIT_FAILURE);
     }
-    memset(u, 0, (n+1) * sizeof(double));
-    // Se definen condiciones de frontera: u[0] y u[n] se mantienen constantes
-    for (i = 0; i <= n; ++i) {
-        f[i] = i * h;
-    }
-    utmp[0] = u[0];
-    utmp[n] = u[n];
-
-    // Inicializar la barrera con el número de hilos
-    pthread_barrier_init(&barrier, NULL, num_threads);
 
     // Reservar memoria para hilos y datos
     threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
     thread_data = (thread_data_t*) malloc(num_threads * sizeof(thread_data_t));
-    if(threads == NULL || thread_data == NULL) {
+    cpus = (int*) malloc(num_threads * sizeof(int));
+    if(threads == NULL || thread_data == NULL || cpus == NULL) {
         fprintf(stderr, "Error al asignar memoria para los hilos\n");
         exit(EXIT_FAILURE);
     }
     
     // Calcular el tamaño del trabajo de cada hilo
-    // Los índices [1, n) se dividen entre los hilos
-    int chunk = (n - 1) / num_threads;
-    int remainder = (n - 1) % num_threads;
-    int start = 1;
+    // Los índices [1, n) se dividen entre los hilos con los bordes de cada
+    // bloque en un múltiplo de la línea de caché (los arreglos empiezan en
+    // una página; JACOBI_GRAIN da el mínimo por bloque)
+    grain = jacobi_grain();
+    bounds = (int*) malloc((num_threads + 1) * sizeof(int));
+    jacobi_partition(n, num_threads, grain, bounds);
+    balance_window = (opts.solver == JACOBI_SOLVER_DIRECT) ? 0 : jacobi_balance_window();
+    busy = (double*) calloc(2 * num_threads, sizeof(double));
+    nparts = jacobi_part_count(n, num_threads, grain);
+
+    // Inicializar la sincronización con el número de hilos
+    jacobi_sync_init(&sync_hilos, num_threads, jacobi_sync_mode(),
+                     jacobi_part_min(num_threads, bounds));
+
+    // CPU de cada hilo según la topología (JACOBI_PLACE); el hilo i barre
+    // el bloque i, así los bloques vecinos quedan en núcleos que comparten caché
+    place = jacobi_place_policy();
+    jacobi_place(place, num_threads, cpus);
     
     // Iniciar la medición del tiempo
     get_time(&tstart);
     
     // Crear hilos
+    pthread_attr_init(&attr);
     for (i = 0; i < num_threads; i++) {
         thread_data[i].tid = i;
-        thread_data[i].istart = start;
-        // Distribuir el resto si es necesario
-        int extra = (i < remainder) ? 1 : 0;
-        thread_data[i].iend = start + chunk + extra;
-        start = thread_data[i].iend;
-        if(pthread_create(&threads[i], NULL, jacobi_thread, (void*) &thread_data[i]) != 0) {
+        thread_data[i].istart = bounds[i];
+        thread_data[i].iend = bounds[i+1];
+        // Fijar la afinidad del hilo a su CPU desde antes de crearlo, para
+        // que el primer contacto ya ocurra ahí
+        if (cpus[i] >= 0) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(cpus[i], &cpuset);
+            if(pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset) != 0) {
+                fprintf(stderr, "Error al fijar la afinidad del hilo %d\n", i);
+            }
+        }
+        if(pthread_create(&threads[i], &attr,
+                          opts.solver == JACOBI_SOLVER_DIRECT ? direct_thread : jacobi_thread,
+                          (void*) &thread_data[i]) != 0) {
             fprintf(stderr, "Error al crear el hilo %d\n", i);
             exit(EXIT_FAILURE);
         }
-        // Fijar la afinidad del hilo al CPU (de forma cíclica si es necesario)
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        int cpu = i % sysconf(_SC_NPROCESSORS_ONLN);
-        CPU_SET(cpu, &cpuset);
-        if(pthread_setaffinity_np(threads[i], sizeof(cpu_set_t), &cpuset) != 0) {
-            fprintf(stderr, "Error al fijar la afinidad del hilo %d\n", i);
-        }
     }
+    pthread_attr_destroy(&attr);
     
     // Esperar a que todos los hilos terminen
     for (i = 0; i < num_threads; i++) {
@@ -151,20 +469,33 @@ int main(int argc, char** argv) {
     
     // Finalizar la medición del tiempo
     get_time(&tend);
-    printf("n: %d\nnsteps: %d\nnum_threads: %d\nElapsed time: %g s\n", 
-           n, nsteps, num_threads, timespec_diff(tstart, tend));
+    printf("n: %d\nnsteps: %d\nnum_threads: %d\nsolver: %s\nsweep: %s\nkernel: %s\nsync: %s\nInit time: %g s\nElapsed time: %g s\n", 
+           n, nsteps, num_threads, jacobi_solver_name(opts.solver), fused_sweep ? "fused" : "split",
+           jacobi_kernel_name(half_sweep), jacobi_sync_name(sync_hilos.mode),
+           (double) timespec_diff(tstart, tinit), (double) timespec_diff(tinit, tend));
+    jacobi_place_print(place, num_threads, cpus);
+    jacobi_part_print(num_threads, bounds);
+    jacobi_print_stats(&opts, &stats);
+    write_numa_report(thread_data, opts.solver == JACOBI_SOLVER_DIRECT ? 1 : stats.sweeps);
+    if (opts.error)
+        printf("error vs direct: %g\n", tridiag_error(n, u, f));
     
     // Escribir la solución en el archivo si se indicó un nombre
     if (fname)
         write_solution(n, u, fname);
     
     // Liberar memoria y destruir la barrera
-    free(u);
-    free(f);
-    free(utmp);
+    jacobi_numa_free(u, n+1);
+    jacobi_numa_free(f, n+1);
+    jacobi_numa_free(utmp, n+1);
     free(threads);
     free(thread_data);
-    pthread_barrier_destroy(&barrier);
+    free(cpus);
+    free(partials);
+    free(sep);
+    free(bounds);
+    free(busy);
+    jacobi_sync_destroy(&sync_hilos);
     
     return 0;
 }
\ No newline at end of file
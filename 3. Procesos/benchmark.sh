@@ -15,7 +15,7 @@ NSTEPS_VALUES=(1000)
 NUM_PROCS=12
 
 # Compilar el programa (se requiere -lrt para semáforos y tiempo, en algunos sistemas)
-gcc -DUSE_CLOCK -O3 processes-jacobi1d.c timing.c -o jacobi -lrt
+gcc -DUSE_CLOCK -O3 processes-jacobi1d.c timing.c jacobi_kernels.c jacobi_opts.c jacobi_topo.c jacobi_part.c -o jacobi -lrt -lm
 
 # Ejecutar benchmarks
 for N in "${N_VALUES[@]}"; do
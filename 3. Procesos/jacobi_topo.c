@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jacobi_topo.h"
+
+#ifndef TOPO_ROOT
+#define TOPO_ROOT "/sys/devices/system/cpu"
+#endif
+
+static const char* place_names[] = { "core", "compact", "scatter", "l3", "none" };
+
+int jacobi_place_policy(void)
+{
+    int p;
+    const char* env = getenv("JACOBI_PLACE");
+
+    if (env == NULL)
+        return JACOBI_PLACE_CORE;
+    for (p = 0; p < 5; ++p)
+        if (strcmp(env, place_names[p]) == 0)
+            return p;
+    fprintf(stderr, "Unknown JACOBI_PLACE '%s'; using core\n", env);
+    return JACOBI_PLACE_CORE;
+}
+
+const char* jacobi_place_name(int policy)
+{
+    return (policy >= 0 && policy < 5) ? place_names[policy] : "unknown";
+}
+
+/* First line of a sysfs file; 0 if it cannot be read */
+static int read_line(const char* path, char* buf, int len)
+{
+    FILE* fp = fopen(path, "r");
+    int ok;
+
+    if (fp == NULL)
+        return 0;
+    ok = fgets(buf, len, fp) != NULL;
+    fclose(fp);
+    if (ok)
+        buf[strcspn(buf, "\n")] = '\0';
+    return ok;
+}
+
+static int read_int(const char* path, int fallback)
+{
+    char buf[32];
+    return read_line(path, buf, sizeof(buf)) ? atoi(buf) : fallback;
+}
+
+/* --
+ * Walk a CPU list such as "0-3,8-11": the lowest CPU in it and, through
+ * rank, how many listed CPUs come before cpu.  Returns -1 if unreadable.
+ */
+static int parse_list(const char* path, int cpu, int* rank)
+{
+    char buf[4096];
+    char* s = buf;
+    int lowest = -1, lo, hi;
+
+    if (rank != NULL)
+        *rank = 0;
+    if (!read_line(path, buf, sizeof(buf)))
+        return -1;
+    while (*s != '\0') {
+        lo = hi = (int) strtol(s, &s, 10);
+        if (*s == '-')
+            hi = (int) strtol(s + 1, &s, 10);
+        if (lowest < 0 || lo < lowest)
+            lowest = lo;
+        if (rank != NULL && lo < cpu)
+            *rank += ((hi < cpu) ? hi : cpu - 1) - lo + 1;
+        if (*s != ',')
+            break;
+        ++s;
+    }
+    return lowest;
+}
+
+static void read_cpu(jacobi_cpu_t* c, int cpu)
+{
+    char path[256], type[32];
+    int k, level, id, top = 0;
+
+    c->cpu = cpu;
+    snprintf(path, sizeof(path), TOPO_ROOT "/cpu%d/topology/physical_package_id", cpu);
+    c->package = read_int(path, 0);
+    snprintf(path, sizeof(path), TOPO_ROOT "/cpu%d/topology/thread_siblings_list", cpu);
+    c->core = parse_list(path, cpu, &c->smt);
+    if (c->core < 0) {
+        c->core = cpu;
+        c->smt = 0;
+    }
+    /* Without cache information every core is its own L2 and the
+     * package its last-level cache */
+    c->l2 = c->core;
+    c->llc = -1;
+    for (k = 0; ; ++k) {
+        snprintf(path, sizeof(path), TOPO_ROOT "/cpu%d/cache/index%d/level", cpu, k);
+        level = read_int(path, -1);
+        if (level < 0)
+            break;
+        snprintf(path, sizeof(path), TOPO_ROOT "/cpu%d/cache/index%d/type", cpu, k);
+        if (level < 2 || !read_line(path, type, sizeof(type)) ||
+            strcmp(type, "Instruction") == 0)
+            continue;
+        snprintf(path, sizeof(path), TOPO_ROOT "/cpu%d/cache/index%d/shared_cpu_list", cpu, k);
+        id = parse_list(path, cpu, NULL);
+        if (id < 0)
+            continue;
+        if (level == 2)
+            c->l2 = id;
+        if (level > top) {
+            top = level;
+            c->llc = id;
+        }
+    }
+}
+
+static int cmp_ints(const int* a, const int* b, int len)
+{
+    int k;
+    for (k = 0; k < len; ++k)
+        if (a[k] != b[k])
+            return (a[k] < b[k]) ? -1 : 1;
+    return 0;
+}
+
+/* Topology order: socket, last-level cache, L2, core, SMT thread */
+static void locality_key(const jacobi_cpu_t* c, int* key)
+{
+    key[0] = c->package;
+    key[1] = c->llc;
+    key[2] = c->l2;
+    key[3] = c->core;
+    key[4] = c->smt;
+}
+
+static int cmp_locality(const void* a, const void* b)
+{
+    int ka[5], kb[5];
+    locality_key((const jacobi_cpu_t*) a, ka);
+    locality_key((const jacobi_cpu_t*) b, kb);
+    return cmp_ints(ka, kb, 5);
+}
+
+int jacobi_topo_load(jacobi_topo_t* t)
+{
+    cpu_set_t allowed;
+    int cpu, ncpus = 0;
+
+    t->ncpus = 0;
+    t->cpu = NULL;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return 0;
+    t->cpu = (jacobi_cpu_t*) malloc(CPU_COUNT(&allowed) * sizeof(jacobi_cpu_t));
+    if (t->cpu == NULL)
+        return 0;
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed))
+            read_cpu(&t->cpu[ncpus++], cpu);
+    qsort(t->cpu, ncpus, sizeof(jacobi_cpu_t), cmp_locality);
+    t->ncpus = ncpus;
+    return ncpus;
+}
+
+void jacobi_topo_free(jacobi_topo_t* t)
+{
+    free(t->cpu);
+    t->cpu = NULL;
+    t->ncpus = 0;
+}
+
+/* A CPU with the key a policy sorts it by */
+typedef struct {
+    int key[5];
+    int index;      /* in topology order */
+} topo_pick_t;
+
+static int cmp_pick(const void* a, const void* b)
+{
+    return cmp_ints(((const topo_pick_t*) a)->key, ((const topo_pick_t*) b)->key, 5);
+}
+
+static int cmp_int(const void* a, const void* b)
+{
+    return *(const int*) a - *(const int*) b;
+}
+
+void jacobi_topo_place(const jacobi_topo_t* t, int policy, int nworkers,
+                       int* cpus)
+{
+    topo_pick_t* pick;
+    int* index;
+    int i, w, npick = 0, dom = -1, rank = 0;
+
+    if (policy == JACOBI_PLACE_NONE || t->ncpus == 0) {
+        for (w = 0; w < nworkers; ++w)
+            cpus[w] = -1;
+        return;
+    }
+    pick = (topo_pick_t*) malloc(t->ncpus * sizeof(topo_pick_t));
+    index = (int*) malloc(nworkers * sizeof(int));
+    for (i = 0; i < t->ncpus; ++i) {
+        const jacobi_cpu_t* c = &t->cpu[i];
+        topo_pick_t* p = &pick[npick];
+        /* Rank of the cache inside its socket and of the CPU inside the
+         * cache among those of the same SMT rank (t->cpu is in topology
+         * order, so both only grow) */
+        if (i == 0 || c->package != t->cpu[i-1].package)
+            dom = -1;
+        if (i == 0 || c->package != t->cpu[i-1].package || c->llc != t->cpu[i-1].llc) {
+            dom++;
+            rank = 0;
+        }
+        memset(p->key, 0, sizeof(p->key));
+        p->index = i;
+        switch (policy) {
+        case JACOBI_PLACE_COMPACT:
+            p->key[0] = i;
+            break;
+        case JACOBI_PLACE_SCATTER:
+            p->key[0] = c->smt;
+            p->key[1] = (c->smt == 0) ? rank : rank - 1;
+            p->key[2] = dom;
+            p->key[3] = c->package;
+            p->key[4] = i;
+            break;
+        case JACOBI_PLACE_L3:
+            if (c->smt != 0 || rank != 0)
+                continue;
+            p->key[0] = i;
+            break;
+        default:    /* JACOBI_PLACE_CORE */
+            p->key[0] = c->smt;
+            p->key[1] = i;
+        }
+        if (c->smt == 0)
+            rank++;
+        npick++;
+    }
+    qsort(pick, npick, sizeof(topo_pick_t), cmp_pick);
+    /* The CPUs the workers take, then in topology order for the chunks */
+    for (w = 0; w < nworkers; ++w)
+        index[w] = pick[w % npick].index;
+    qsort(index, nworkers, sizeof(int), cmp_int);
+    for (w = 0; w < nworkers; ++w)
+        cpus[w] = t->cpu[index[w]].cpu;
+    free(pick);
+    free(index);
+}
+
+void jacobi_place(int policy, int nworkers, int* cpus)
+{
+    jacobi_topo_t t;
+    jacobi_topo_load(&t);
+    jacobi_topo_place(&t, policy, nworkers, cpus);
+    jacobi_topo_free(&t);
+}
+
+int jacobi_pin_self(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return 0;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    /* pid 0 is the calling thread */
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+void jacobi_place_print(int policy, int nworkers, const int* cpus)
+{
+    int w;
+
+    printf("place: %s", jacobi_place_name(policy));
+    if (policy != JACOBI_PLACE_NONE) {
+        printf(" (cpus");
+        for (w = 0; w < nworkers; ++w)
+            printf(" %d", cpus[w]);
+        printf(")");
+    }
+    printf("\n");
+}
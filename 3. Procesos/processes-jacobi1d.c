@@ -1,62 +1,250 @@
 #define _GNU_SOURCE
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include <semaphore.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "jacobi_topo.h"
+#include "jacobi_part.h"
 
-/* Barrera reutilizable basada en dos turnstiles */
+#define LINEA 64
+
+/* --
+ * Barrera para procesos en memoria compartida, con atómicos y futex.  El
+ * contador de llegadas y la generación viven en líneas de caché distintas.
+ * Cada proceso suma uno al contador; el último lo vuelve a cero, avanza la
+ * generación y, solo si alguien se durmió, despierta a todos con
+ * FUTEX_WAKE.  Los demás miran la generación hasta spin veces (con pause)
+ * y después duermen en ella con FUTEX_WAIT, que no duerme si ya cambió.
+ * Sin contención es una operación atómica por proceso y ninguna llamada al
+ * sistema, en vez de las seis operaciones de semáforo de los dos
+ * turnstiles.  El futex no es privado: la página es compartida entre
+ * procesos.
+ */
 typedef struct {
-    int count;
-    int n; // número total de procesos
-    sem_t mutex;
-    sem_t turnstile1;
-    sem_t turnstile2;
+    int n;          // número total de procesos
+    int spin;       // vueltas mirando la generación antes de dormir
+    char pad0[LINEA - 2*sizeof(int)];
+    int count;      // procesos que llegaron en esta generación
+    char pad1[LINEA - sizeof(int)];
+    int gen;        // la avanza el último en llegar
+    int sleepers;   // procesos dormidos (o por dormirse) en el futex
+    char pad2[LINEA - 2*sizeof(int)];
 } barrier_t;
 
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/* Vueltas de espera activa: JACOBI_SPIN, o por defecto 1000 si hay un CPU
+ * para cada proceso y 0 (dormir enseguida) si hay más procesos que CPUs */
+int barrier_spin(int n) {
+    const char* env = getenv("JACOBI_SPIN");
+    if(env != NULL)
+        return atoi(env) > 0 ? atoi(env) : 0;
+    return (n <= sysconf(_SC_NPROCESSORS_ONLN)) ? 1000 : 0;
+}
+
 /* Inicializa la barrera en memoria compartida */
-void barrier_init(barrier_t *b, int n) {
+void barrier_init(barrier_t *b, int n, int spin) {
+    memset(b, 0, sizeof(barrier_t));
     b->n = n;
-    b->count = 0;
-    sem_init(&b->mutex, 1, 1);       // pshared = 1
-    sem_init(&b->turnstile1, 1, 0);    // cerrado
-    sem_init(&b->turnstile2, 1, 1);    // abierto
+    b->spin = spin;
 }
 
-/* Espera en la barrera; algoritmo de dos fases */
 void barrier_wait(barrier_t *b) {
-    // Fase 1
-    sem_wait(&b->mutex);
-    b->count++;
-    if(b->count == b->n) {
-        sem_wait(&b->turnstile2);  // cerrar la segunda puerta
-        sem_post(&b->turnstile1);  // abrir la primera puerta
+    int gen = __atomic_load_n(&b->gen, __ATOMIC_ACQUIRE);
+    int k;
+
+    if(__atomic_add_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == b->n) {
+        // Último en llegar: nadie vuelve a sumar hasta ver la nueva generación
+        __atomic_store_n(&b->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&b->gen, gen + 1, __ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&b->sleepers, __ATOMIC_SEQ_CST) > 0)
+            syscall(SYS_futex, &b->gen, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        return;
     }
-    sem_post(&b->mutex);
+    for(k = 0; k < b->spin; k++) {
+        if(__atomic_load_n(&b->gen, __ATOMIC_ACQUIRE) != gen)
+            return;
+        cpu_relax();
+    }
+    // Anotarse antes de volver a mirar: o el último ve sleepers > 0 y
+    // despierta, o acá se ve la generación nueva y no se duerme
+    __atomic_add_fetch(&b->sleepers, 1, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&b->gen, __ATOMIC_SEQ_CST) == gen)
+        syscall(SYS_futex, &b->gen, FUTEX_WAIT, gen, NULL, NULL, 0);
+    __atomic_sub_fetch(&b->sleepers, 1, __ATOMIC_RELEASE);
+}
+
+/* --
+ * Modo privado (JACOBI_MEM=private): cada proceso tiene sus propios u, utmp
+ * y f con una celda fantasma a cada lado, como un proceso MPI, y los
+ * valores de borde viajan por anillos de un productor y un consumidor en
+ * memoria compartida, dos por cada par de vecinos (uno en cada sentido).
+ * head solo lo escribe el productor y tail solo el consumidor, cada uno en
+ * su línea; cada extremo guarda además su propia copia de la posición del
+ * otro y solo vuelve a leer la línea compartida cuando el anillo parece
+ * lleno o vacío.  Por sweep se mueven un par de líneas por vecino, en vez
+ * de que todos los accesos a los bordes pasen por la coherencia de caché.
+ */
+#define ANILLO 64   // valores en vuelo por anillo (potencia de dos)
 
-    sem_wait(&b->turnstile1);
-    sem_post(&b->turnstile1);
+typedef struct {
+    unsigned long head;     // valores escritos
+    char pad0[LINEA - sizeof(unsigned long)];
+    unsigned long tail;     // valores leídos
+    char pad1[LINEA - sizeof(unsigned long)];
+    double slot[ANILLO];
+} ring_t;
+
+/* Un extremo de un anillo, en memoria privada del proceso */
+typedef struct {
+    ring_t *r;
+    unsigned long mio;      // próxima posición a escribir o leer
+    unsigned long otro;     // última posición vista del otro extremo
+} ring_end_t;
 
-    // Fase 2
-    sem_wait(&b->mutex);
-    b->count--;
-    if(b->count == 0) {
-        sem_wait(&b->turnstile1);  // cerrar la primera puerta
-        sem_post(&b->turnstile2);  // abrir la segunda puerta
+/* Espera acotada con pause; después cede el CPU, por si hay más procesos que CPUs */
+static void esperar_un_poco(int *vueltas) {
+    int k;
+    if(*vueltas < 1024) {
+        for(k = 0; k < *vueltas; k++)
+            cpu_relax();
+        *vueltas *= 2;
+    } else {
+        sched_yield();
     }
-    sem_post(&b->mutex);
+}
+
+static void ring_send(ring_end_t *e, double v) {
+    int vueltas = 1;
+    while(e->mio - e->otro == ANILLO) {
+        e->otro = __atomic_load_n(&e->r->tail, __ATOMIC_ACQUIRE);
+        if(e->mio - e->otro == ANILLO)
+            esperar_un_poco(&vueltas);
+    }
+    e->r->slot[e->mio % ANILLO] = v;
+    __atomic_store_n(&e->r->head, ++e->mio, __ATOMIC_RELEASE);
+}
+
+static double ring_recv(ring_end_t *e) {
+    int vueltas = 1;
+    double v;
+    while(e->otro == e->mio) {
+        e->otro = __atomic_load_n(&e->r->head, __ATOMIC_ACQUIRE);
+        if(e->otro == e->mio)
+            esperar_un_poco(&vueltas);
+    }
+    v = e->r->slot[e->mio % ANILLO];
+    __atomic_store_n(&e->r->tail, ++e->mio, __ATOMIC_RELEASE);
+    return v;
+}
 
-    sem_wait(&b->turnstile2);
-    sem_post(&b->turnstile2);
+/* --
+ * Manda los bordes propios de a (a[1] y a[m]) y recibe las celdas fantasma
+ * a[0] y a[m+1].  e[0] y e[1] mandan y reciben del vecino de la
+ * izquierda, e[2] y e[3] del de la derecha; los .r en NULL no tienen
+ * vecino (borde del dominio).  Primero se manda y después se recibe, así
+ * nadie espera a un vecino que a su vez lo espera.
+ */
+static void intercambiar(double *a, int m, ring_end_t *e) {
+    if(e[0].r != NULL) ring_send(&e[0], a[1]);
+    if(e[2].r != NULL) ring_send(&e[2], a[m]);
+    if(e[1].r != NULL) a[0] = ring_recv(&e[1]);
+    if(e[3].r != NULL) a[m+1] = ring_recv(&e[3]);
 }
 
-void barrier_destroy(barrier_t *b) {
-    sem_destroy(&b->mutex);
-    sem_destroy(&b->turnstile1);
-    sem_destroy(&b->turnstile2);
+/* --
+ * Trabajo del proceso i en modo privado sobre [start, end).  El índice
+ * local j es el global start - 1 + j.  Las celdas fantasma reemplazan a las
+ * barreras entre sweeps: recibir el borde del vecino ya implica que el
+ * vecino terminó el sweep anterior.  Solo los chequeos del residuo, que
+ * suman los parciales de todos, pasan por la barrera.  Al final cada uno
+ * copia su bloque al u compartido para que el padre escriba la solución.
+ */
+static void hijo_privado(int i, int start, int end, int n, int nsteps,
+                         int num_procs, const jacobi_opts_t *opts,
+                         ring_t *rings, barrier_t *barrier, double *partials,
+                         jacobi_stats_t *stats, double *u) {
+    int m = end - start, j, sweep, check, done = 0;
+    double h = 1.0 / n, h2 = h * h, total[2];
+    double *parts = partials, *norms = partials;
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
+    jacobi_sweep_res_t sweep_res = jacobi_sweep_res_kernel();
+    jacobi_stats_t mis_stats = *stats;
+    double *ul = jacobi_alloc(m + 2);
+    double *utl = jacobi_alloc(m + 2);
+    double *fl = jacobi_alloc(m + 2);
+    ring_end_t e[4];
+
+    if(ul == NULL || utl == NULL || fl == NULL) {
+        perror("jacobi_alloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(ul, 0, (m + 2) * sizeof(double));
+    memset(utl, 0, (m + 2) * sizeof(double));
+    for(j = 0; j <= m + 1; j++)
+        fl[j] = (start - 1 + j) * h;
+    // El anillo 2k lleva valores de k a k+1 y el 2k+1 de k+1 a k; los
+    // bloques vacíos (al final) no tienen vecinos
+    memset(e, 0, sizeof(e));
+    if(m > 0 && start > 1) {
+        e[0].r = &rings[2*(i-1) + 1];
+        e[1].r = &rings[2*(i-1)];
+    }
+    if(m > 0 && end < n) {
+        e[2].r = &rings[2*i];
+        e[3].r = &rings[2*i + 1];
+    }
+
+    for(sweep = 0; sweep < nsteps - 1 && !done; sweep += 2) {
+        check = jacobi_check_due(opts, sweep);
+        if(check) {
+            parts = partials + 2 * num_procs * (sweep / opts->check % 2);
+            norms = parts + 2 * i;
+            norms[0] = norms[1] = 0;
+        }
+        intercambiar(ul, m, e);
+        if(check)
+            sweep_res(utl, ul, fl, h2, 1, m + 1, norms);
+        else
+            half_sweep(utl, ul, fl, h2, 1, m + 1);
+        intercambiar(utl, m, e);
+        half_sweep(ul, utl, fl, h2, 1, m + 1);
+        if(check) {
+            barrier_wait(barrier);
+            jacobi_sum_norms(parts, num_procs, total);
+            done = jacobi_converged(opts, &mis_stats, sweep, total, h);
+        }
+    }
+    // Si nsteps es impar, se realiza un sweep extra
+    if(nsteps % 2 != 0 && !done) {
+        intercambiar(ul, m, e);
+        half_sweep(utl, ul, fl, h2, 1, m + 1);
+        memcpy(ul + 1, utl + 1, m * sizeof(double));
+        sweep++;
+    }
+    memcpy(u + start, ul + 1, m * sizeof(double));
+    if(i == 0) {
+        mis_stats.sweeps = sweep;
+        *stats = mis_stats;
+    }
+    free(ul);
+    free(utl);
+    free(fl);
 }
 
 void write_solution(int n, double* u, const char* fname) {
@@ -75,15 +263,28 @@ int main(int argc, char** argv) {
     int i;
     char* fname;
     timing_t tstart, tend;
+    jacobi_opts_t opts;
     
     // Procesar argumentos:
     // Uso: ./jacobi_proc [n] [nsteps] [num_procs] [fname-opcional]
+    // (--tol X y --check K se pueden poner en cualquier lugar y se quitan de argv)
+    jacobi_parse_opts(&argc, argv, &opts);
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI));
     int n = (argc > 1) ? atoi(argv[1]) : 100;
     int nsteps = (argc > 2) ? atoi(argv[2]) : 100;
     int num_procs = (argc > 3) ? atoi(argv[3]) : 2;
     fname  = (argc > 4) ? argv[4] : NULL;
     double h = 1.0 / n;
     double h2 = h * h;
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
+    jacobi_fused_t fused_sweep = jacobi_use_fused() ? jacobi_fused_kernel() : NULL;
+    jacobi_sweep_res_t sweep_res = jacobi_sweep_res_kernel();
+    jacobi_fused_res_t fused_res = jacobi_fused_res_kernel();
+    // JACOBI_MEM=private: arreglos privados por proceso y bordes por anillos
+    const char* mem = getenv("JACOBI_MEM");
+    int privado = mem != NULL && strcmp(mem, "private") == 0;
+    if(mem != NULL && !privado && strcmp(mem, "shared") != 0)
+        fprintf(stderr, "JACOBI_MEM desconocido '%s'; se usa shared\n", mem);
     
     // Crear memoria compartida para los arreglos u, f, utmp
     double *u = mmap(NULL, (n+1)*sizeof(double),
@@ -112,62 +313,132 @@ int main(int argc, char** argv) {
         perror("mmap barrier");
         exit(EXIT_FAILURE);
     }
-    barrier_init(barrier, num_procs);
+    barrier_init(barrier, num_procs, barrier_spin(num_procs));
     
-    // Dividir el dominio entre los procesos (índices [1, n))
-    int chunk = (n - 1) / num_procs;
-    int remainder = (n - 1) % num_procs;
-    int start = 1;
+    // Residuo parcial de cada proceso (2 juegos x 2 valores) y estadísticas
+    // finales, también compartidos para que el padre pueda leerlas
+    double *partials = mmap(NULL, 4*num_procs*sizeof(double),
+                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    jacobi_stats_t *stats = mmap(NULL, sizeof(jacobi_stats_t),
+                                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(partials == MAP_FAILED || stats == MAP_FAILED){
+        perror("mmap partials");
+        exit(EXIT_FAILURE);
+    }
+    memset(stats, 0, sizeof(jacobi_stats_t));
+    
+    // Anillos entre procesos vecinos (solo en modo privado)
+    size_t rings_size = 2 * num_procs * sizeof(ring_t);
+    ring_t *rings = NULL;
+    if(privado) {
+        rings = mmap(NULL, rings_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(rings == MAP_FAILED){
+            perror("mmap rings");
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    // Dividir el dominio entre los procesos (índices [1, n)) con los bordes
+    // de cada bloque en un múltiplo de la línea de caché: los arreglos
+    // empiezan en una página y dos procesos nunca escriben la misma línea
+    // (JACOBI_GRAIN da el mínimo por bloque)
+    int *bounds = malloc((num_procs + 1) * sizeof(int));
+    if(bounds == NULL){
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    jacobi_partition(n, num_procs, jacobi_grain(), bounds);
     
     // Arreglo para almacenar los pids de los procesos hijos
     pid_t *pids = malloc(num_procs * sizeof(pid_t));
-    if(pids == NULL){
+    int *cpus = malloc(num_procs * sizeof(int));
+    if(pids == NULL || cpus == NULL){
         perror("malloc");
         exit(EXIT_FAILURE);
     }
+
+    // CPU de cada proceso según la topología (JACOBI_PLACE); el proceso i
+    // barre el bloque i, así los bloques vecinos comparten caché
+    int place = jacobi_place_policy();
+    jacobi_place(place, num_procs, cpus);
     
     // Iniciar la medición del tiempo
     get_time(&tstart);
     
     for(i = 0; i < num_procs; i++){
-        int extra = (i < remainder) ? 1 : 0;
-        int end = start + chunk + extra;
+        int start = bounds[i];
+        int end = bounds[i+1];
         pid_t pid = fork();
         if(pid < 0) {
             perror("fork");
             exit(EXIT_FAILURE);
         } else if(pid == 0) {
             // Proceso hijo: ejecutar su porción
-            int sweep, j;
-            for(sweep = 0; sweep < nsteps - 1; sweep += 2) {
-                // Primer sweep: calcular utmp a partir de u
-                for(j = start; j < end; j++){
-                    utmp[j] = (u[j-1] + u[j+1] + h2 * f[j]) / 2.0;
+            int sweep, j, flags, check, done = 0;
+            double halo[4], total[2];
+            double *parts = partials, *norms = partials;
+            jacobi_stats_t mis_stats = *stats;
+            jacobi_pin_self(cpus[i]);
+            if(privado) {
+                hijo_privado(i, start, end, n, nsteps, num_procs, &opts,
+                             rings, barrier, partials, stats, u);
+                exit(EXIT_SUCCESS);
+            }
+            for(sweep = 0; sweep < nsteps - 1 && !done; sweep += 2) {
+                // Los chequeos de residuo seguidos alternan entre dos juegos de
+                // parciales, así ningún proceso pisa valores que otro está sumando
+                check = jacobi_check_due(&opts, sweep);
+                if(check) {
+                    parts = partials + 2 * num_procs * (sweep / opts.check % 2);
+                    norms = parts + 2 * i;
+                    norms[0] = norms[1] = 0;
                 }
-                barrier_wait(barrier);
-                // Segundo sweep: calcular u a partir de utmp
-                for(j = start; j < end; j++){
-                    u[j] = (utmp[j-1] + utmp[j+1] + h2 * f[j]) / 2.0;
+                if(fused_sweep != NULL) {
+                    // Guardar los valores vecinos antes de que otro proceso los sobrescriba
+                    flags = jacobi_halo(u, start, end, start == 1, end == n, halo);
+                    barrier_wait(barrier);
+                    // Los dos sweeps en el mismo arreglo: u^k -> u^{k+2}
+                    if(check)
+                        fused_res(u, f, h2, start, end, halo, flags, norms);
+                    else
+                        fused_sweep(u, f, h2, start, end, halo, flags);
+                } else {
+                    // Primer sweep: calcular utmp a partir de u
+                    if(check)
+                        sweep_res(utmp, u, f, h2, start, end, norms);
+                    else
+                        half_sweep(utmp, u, f, h2, start, end);
+                    barrier_wait(barrier);
+                    // Segundo sweep: calcular u a partir de utmp
+                    half_sweep(u, utmp, f, h2, start, end);
                 }
                 barrier_wait(barrier);
+                // Todos suman los parciales en el mismo orden y toman la misma decisión
+                if(check) {
+                    jacobi_sum_norms(parts, num_procs, total);
+                    done = jacobi_converged(&opts, &mis_stats, sweep, total, h);
+                }
             }
             // Si nsteps es impar, se realiza un sweep extra
-            if(nsteps % 2 != 0) {
-                for(j = start; j < end; j++){
-                    utmp[j] = (u[j-1] + u[j+1] + h2 * f[j]) / 2.0;
-                }
+            if(nsteps % 2 != 0 && !done) {
+                half_sweep(utmp, u, f, h2, start, end);
                 barrier_wait(barrier);
                 for(j = start; j < end; j++){
                     u[j] = utmp[j];
                 }
                 barrier_wait(barrier);
+                sweep++;
+            }
+            if(i == 0) {
+                mis_stats.sweeps = sweep;
+                *stats = mis_stats;
             }
             exit(EXIT_SUCCESS);
         } else {
             // Proceso padre guarda el pid del hijo
             pids[i] = pid;
         }
-        start = end;
     }
     
     // El proceso padre espera a que todos los hijos finalicen
@@ -176,19 +447,34 @@ int main(int argc, char** argv) {
     }
     
     get_time(&tend);
-    printf("n: %d\nnsteps: %d\nnum_procs: %d\nElapsed time: %g s\n",
-           n, nsteps, num_procs, timespec_diff(tstart, tend));
+    printf("n: %d\nnsteps: %d\nnum_procs: %d\nsweep: %s\nkernel: %s\nElapsed time: %g s\n",
+           n, nsteps, num_procs, (fused_sweep && !privado) ? "fused" : "split",
+           jacobi_kernel_name(half_sweep),
+           timespec_diff(tstart, tend));
+    printf("barrier: futex (spin %d)\n", barrier->spin);
+    if(privado)
+        printf("memory: private (anillos de %d valores)\n", ANILLO);
+    else
+        printf("memory: shared\n");
+    jacobi_place_print(place, num_procs, cpus);
+    jacobi_part_print(num_procs, bounds);
+    jacobi_print_stats(&opts, stats);
     
     if(fname)
         write_solution(n, u, fname);
     
-    // Limpieza: destruir la barrera y liberar la memoria compartida
-    barrier_destroy(barrier);
+    // Limpieza: liberar la memoria compartida
     munmap(u, (n+1)*sizeof(double));
     munmap(f, (n+1)*sizeof(double));
     munmap(utmp, (n+1)*sizeof(double));
     munmap(barrier, sizeof(barrier_t));
+    munmap(partials, 4*num_procs*sizeof(double));
+    munmap(stats, sizeof(jacobi_stats_t));
+    if(rings != NULL)
+        munmap(rings, rings_size);
     free(pids);
+    free(cpus);
+    free(bounds);
     
     return 0;
 }
\ No newline at end of file
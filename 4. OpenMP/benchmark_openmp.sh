@@ -20,3 +20,48 @@ for T in "${THREADS[@]}"; do
 
   echo "Benchmark OpenMP con $T hilos completado. Resultados en $OUTFILE"
 done
+
+
+# Jacobi contra los solvers exactos: puntos actualizados por segundo
+# (N*BARRIDOS/TIEMPO; nsteps ya cuenta barridos, direct y fft cuentan una
+# sola vez)
+for T in "${THREADS[@]}"; do
+  OUTFILE="resultados_benchmark_solvers_omp_${T}.csv"
+  echo "N,SOLVER,BARRIDOS,TIEMPO(s),PUNTOS/s" > "$OUTFILE"
+
+  for N in "${N_VALUES[@]}"; do
+    for SOLVER in jacobi direct fft; do
+      STEPS=$([ "$SOLVER" = jacobi ] && echo 1000 || echo 1)
+      SWEEPS=$([ "$SOLVER" = jacobi ] && echo 1000 || echo 1)
+      echo "Ejecutando N=$N, SOLVER=$SOLVER, HILOS=$T"
+      TIEMPO=$(./jacobi1d_openmp $N $STEPS $T --solver $SOLVER | grep "Elapsed time" | awk '{print $3}')
+      PPS=$(awk -v n=$N -v s=$SWEEPS -v t=$TIEMPO 'BEGIN { printf "%g", n*s/t }')
+      echo "$N,$SOLVER,$SWEEPS,$TIEMPO,$PPS" >> "$OUTFILE"
+      sleep 1
+    done
+  done
+
+  echo "Comparación de solvers con $T hilos completada. Resultados en $OUTFILE"
+done
+
+
+# Jacobi por tareas (frente de onda) contra la región paralela con barreras:
+# BLOQUE = 0 es la región; si no, puntos por tarea y sweeps en vuelo
+for T in "${THREADS[@]}"; do
+  OUTFILE="resultados_benchmark_tareas_omp_${T}.csv"
+  echo "N,BLOQUE,EN_VUELO,TIEMPO(s)" > "$OUTFILE"
+
+  for N in 10000 100000 1000000; do
+    for BLOQUE in 0 1024 4096 16384; do
+      for DEPTH in 2 8 32; do
+        [ "$BLOQUE" = 0 ] && [ "$DEPTH" != 2 ] && continue
+        echo "Ejecutando N=$N, BLOQUE=$BLOQUE, EN_VUELO=$DEPTH, HILOS=$T"
+        TIEMPO=$(JACOBI_TASKS=$BLOQUE JACOBI_TASK_DEPTH=$DEPTH ./jacobi1d_openmp $N 2000 $T | grep "Elapsed time" | awk '{print $3}')
+        echo "$N,$BLOQUE,$DEPTH,$TIEMPO" >> "$OUTFILE"
+        sleep 1
+      done
+    done
+  done
+
+  echo "Comparación de tareas con $T hilos completada. Resultados en $OUTFILE"
+done
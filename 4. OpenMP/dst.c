@@ -0,0 +1,481 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dst.h"
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+/* FFTs up to this length run as plain Stockham passes (64 KB of data) */
+#define DST_BLOCK 4096
+
+/* Columns the four-step FFT gathers into one contiguous block */
+#define DST_COLS 16
+
+/* Loops shorter than this are not worth a parallel region */
+#define DST_OMP_GRAIN 8192
+
+#define DST_MAX_FACTORS 64
+
+typedef struct {
+    double re, im;
+} cplx_t;
+
+static inline cplx_t cadd(cplx_t a, cplx_t b)
+{
+    cplx_t c = { a.re + b.re, a.im + b.im };
+    return c;
+}
+
+static inline cplx_t csub(cplx_t a, cplx_t b)
+{
+    cplx_t c = { a.re - b.re, a.im - b.im };
+    return c;
+}
+
+static inline cplx_t cmul(cplx_t a, cplx_t b)
+{
+    cplx_t c = { a.re*b.re - a.im*b.im, a.re*b.im + a.im*b.re };
+    return c;
+}
+
+static inline cplx_t cscale(cplx_t a, double s)
+{
+    cplx_t c = { a.re*s, a.im*s };
+    return c;
+}
+
+/* -i * a */
+static inline cplx_t cmuli(cplx_t a)
+{
+    cplx_t c = { a.im, -a.re };
+    return c;
+}
+
+
+/* --
+ * FFT plans.  fft_plan_t is one length with its radices and twiddles
+ * w[k] = exp(-2 pi i k/n); fft_t adds the four-step split n = n1*n2
+ * used above DST_BLOCK (n1 = 0 below it).
+ */
+typedef struct {
+    int n;
+    int nf;
+    int f[DST_MAX_FACTORS];
+    cplx_t* w;
+} fft_plan_t;
+
+typedef struct {
+    fft_plan_t all;
+    int n1, n2;
+    fft_plan_t p1, p2;
+} fft_t;
+
+/* Radices of n, fours first; -1 if n has other prime factors */
+static int fft_factor(int n, int* f)
+{
+    int nf = 0;
+
+    if (n < 1)
+        return -1;
+    while (n % 4 == 0) { f[nf++] = 4; n /= 4; }
+    while (n % 2 == 0) { f[nf++] = 2; n /= 2; }
+    while (n % 3 == 0) { f[nf++] = 3; n /= 3; }
+    while (n % 5 == 0) { f[nf++] = 5; n /= 5; }
+    return (n == 1) ? nf : -1;
+}
+
+static int fft_plan_init(fft_plan_t* p, int n)
+{
+    int k;
+
+    p->n = n;
+    p->w = NULL;
+    p->nf = fft_factor(n, p->f);
+    if (p->nf < 0)
+        return -1;
+
+    p->w = (cplx_t*) malloc(n * sizeof(cplx_t));
+    for (k = 0; k < n; ++k) {
+        p->w[k].re =  cos(2*M_PI*k / n);
+        p->w[k].im = -sin(2*M_PI*k / n);
+    }
+    return 0;
+}
+
+static int fft_init(fft_t* t, int n)
+{
+    int i;
+
+    t->n1 = t->n2 = 0;
+    t->p1.w = t->p2.w = NULL;
+    if (fft_plan_init(&t->all, n) < 0)
+        return -1;
+    if (n <= DST_BLOCK)
+        return 0;
+
+    /* n1 takes leading radices up to about sqrt(n) */
+    t->n1 = 1;
+    for (i = 0; i < t->all.nf && (long) t->n1 * t->n1 < n; ++i)
+        t->n1 *= t->all.f[i];
+    t->n2 = n / t->n1;
+    fft_plan_init(&t->p1, t->n1);
+    fft_plan_init(&t->p2, t->n2);
+    return 0;
+}
+
+static void fft_free(fft_t* t)
+{
+    free(t->all.w);
+    free(t->p1.w);
+    free(t->p2.w);
+}
+
+
+/* --
+ * Stockham passes.  A pass of radix r takes s interleaved sequences of
+ * length r*m from x to y (x[q + s*(k + j*m)] -> y[q + s*(r*k + t)]);
+ * the inner loop runs over q with unit stride.  The twiddle
+ * exp(-2 pi i k t/(r m)) is w[k*t*s] of the whole plan.
+ */
+static void pass2(int m, int s, const cplx_t* w, const cplx_t* x, cplx_t* y)
+{
+    int k, q;
+
+    for (k = 0; k < m; ++k) {
+        cplx_t w1 = w[k*s];
+        const cplx_t* a0 = x + s*k;
+        const cplx_t* a1 = x + s*(k + m);
+        cplx_t* y0 = y + s*(2*k);
+        cplx_t* y1 = y0 + s;
+
+        for (q = 0; q < s; ++q) {
+            y0[q] = cadd(a0[q], a1[q]);
+            y1[q] = cmul(csub(a0[q], a1[q]), w1);
+        }
+    }
+}
+
+static void pass3(int m, int s, const cplx_t* w, const cplx_t* x, cplx_t* y)
+{
+    int k, q;
+    const double s3 = 0.86602540378443864676;   /* sin(2 pi/3) */
+
+    for (k = 0; k < m; ++k) {
+        cplx_t w1 = w[k*s], w2 = w[2*k*s];
+        const cplx_t* a0 = x + s*k;
+        const cplx_t* a1 = a0 + s*m;
+        const cplx_t* a2 = a1 + s*m;
+        cplx_t* y0 = y + s*(3*k);
+        cplx_t* y1 = y0 + s;
+        cplx_t* y2 = y1 + s;
+
+        for (q = 0; q < s; ++q) {
+            cplx_t t1 = cadd(a1[q], a2[q]);
+            cplx_t b  = csub(a0[q], cscale(t1, 0.5));
+            cplx_t d  = cscale(cmuli(csub(a1[q], a2[q])), s3);
+            y0[q] = cadd(a0[q], t1);
+            y1[q] = cmul(cadd(b, d), w1);
+            y2[q] = cmul(csub(b, d), w2);
+        }
+    }
+}
+
+static void pass4(int m, int s, const cplx_t* w, const cplx_t* x, cplx_t* y)
+{
+    int k, q;
+
+    for (k = 0; k < m; ++k) {
+        cplx_t w1 = w[k*s], w2 = w[2*k*s], w3 = w[3*k*s];
+        const cplx_t* a0 = x + s*k;
+        const cplx_t* a1 = a0 + s*m;
+        const cplx_t* a2 = a1 + s*m;
+        const cplx_t* a3 = a2 + s*m;
+        cplx_t* y0 = y + s*(4*k);
+        cplx_t* y1 = y0 + s;
+        cplx_t* y2 = y1 + s;
+        cplx_t* y3 = y2 + s;
+
+        for (q = 0; q < s; ++q) {
+            cplx_t t0 = cadd(a0[q], a2[q]);
+            cplx_t t1 = csub(a0[q], a2[q]);
+            cplx_t t2 = cadd(a1[q], a3[q]);
+            cplx_t t3 = cmuli(csub(a1[q], a3[q]));
+            y0[q] = cadd(t0, t2);
+            y1[q] = cmul(cadd(t1, t3), w1);
+            y2[q] = cmul(csub(t0, t2), w2);
+            y3[q] = cmul(csub(t1, t3), w3);
+        }
+    }
+}
+
+static void pass5(int m, int s, const cplx_t* w, const cplx_t* x, cplx_t* y)
+{
+    int k, q;
+    const double c1 =  0.30901699437494742410;   /* cos(2 pi/5) */
+    const double c2 = -0.80901699437494742410;   /* cos(4 pi/5) */
+    const double s1 =  0.95105651629515357212;   /* sin(2 pi/5) */
+    const double s2 =  0.58778525229247312917;   /* sin(4 pi/5) */
+
+    for (k = 0; k < m; ++k) {
+        cplx_t w1 = w[k*s], w2 = w[2*k*s], w3 = w[3*k*s], w4 = w[4*k*s];
+        const cplx_t* a0 = x + s*k;
+        const cplx_t* a1 = a0 + s*m;
+        const cplx_t* a2 = a1 + s*m;
+        const cplx_t* a3 = a2 + s*m;
+        const cplx_t* a4 = a3 + s*m;
+        cplx_t* y0 = y + s*(5*k);
+        cplx_t* y1 = y0 + s;
+        cplx_t* y2 = y1 + s;
+        cplx_t* y3 = y2 + s;
+        cplx_t* y4 = y3 + s;
+
+        for (q = 0; q < s; ++q) {
+            cplx_t t1 = cadd(a1[q], a4[q]), t2 = cadd(a2[q], a3[q]);
+            cplx_t t3 = csub(a1[q], a4[q]), t4 = csub(a2[q], a3[q]);
+            cplx_t b1 = cadd(a0[q], cadd(cscale(t1, c1), cscale(t2, c2)));
+            cplx_t b2 = cadd(a0[q], cadd(cscale(t1, c2), cscale(t2, c1)));
+            cplx_t d1 = cmuli(cadd(cscale(t3, s1), cscale(t4, s2)));
+            cplx_t d2 = cmuli(csub(cscale(t3, s2), cscale(t4, s1)));
+            y0[q] = cadd(a0[q], cadd(t1, t2));
+            y1[q] = cmul(cadd(b1, d1), w1);
+            y2[q] = cmul(cadd(b2, d2), w2);
+            y3[q] = cmul(csub(b2, d2), w3);
+            y4[q] = cmul(csub(b1, d1), w4);
+        }
+    }
+}
+
+/* FFT of x in place by Stockham passes; y is scratch of the same length */
+static void fft_small(const fft_plan_t* p, cplx_t* x, cplx_t* y)
+{
+    int i, m = p->n, s = 1;
+    cplx_t *src = x, *dst = y, *t;
+
+    for (i = 0; i < p->nf; ++i) {
+        int r = p->f[i];
+        m /= r;
+        switch (r) {
+        case 2: pass2(m, s, p->w, src, dst); break;
+        case 3: pass3(m, s, p->w, src, dst); break;
+        case 4: pass4(m, s, p->w, src, dst); break;
+        case 5: pass5(m, s, p->w, src, dst); break;
+        }
+        s *= r;
+        t = src; src = dst; dst = t;
+    }
+    if (src != x)
+        memcpy(x, src, p->n * sizeof(cplx_t));
+}
+
+/* --
+ * FFT of x (scratch work, same length); returns x or work, whichever
+ * holds the result.  Long FFTs use the four-step algorithm on x viewed
+ * as an n1 x n2 matrix x[j1*n2 + j2]:
+ *
+ *  1. length-n1 FFTs down the columns, DST_COLS columns at a time copied
+ *     into a contiguous block, times the twiddles exp(-2 pi i j2 k1/n)
+ *  2. length-n2 FFTs along the rows, which are contiguous
+ *  3. transpose, X[k1 + n1*k2] = x[k1*n2 + k2], in tiles
+ */
+static cplx_t* fft_run(const fft_t* t, cplx_t* x, cplx_t* work)
+{
+    int n1 = t->n1, n2 = t->n2;
+    int c, k1, i0;
+
+    if (n1 == 0) {
+        fft_small(&t->all, x, work);
+        return x;
+    }
+
+    #pragma omp parallel if (n1*n2 > DST_OMP_GRAIN)
+    {
+        cplx_t* buf = (cplx_t*) malloc(2 * DST_COLS * n1 * sizeof(cplx_t));
+
+        #pragma omp for schedule(static)
+        for (c = 0; c < n2; c += DST_COLS) {
+            int b, j, nc = (n2 - c < DST_COLS) ? n2 - c : DST_COLS;
+
+            for (j = 0; j < n1; ++j)
+                for (b = 0; b < nc; ++b)
+                    buf[b*n1 + j] = x[j*n2 + c + b];
+            for (b = 0; b < nc; ++b) {
+                cplx_t* col = buf + b*n1;
+                fft_small(&t->p1, col, buf + DST_COLS*n1);
+                for (j = 1; j < n1; ++j)
+                    col[j] = cmul(col[j], t->all.w[j*(c + b)]);
+            }
+            for (j = 0; j < n1; ++j)
+                for (b = 0; b < nc; ++b)
+                    x[j*n2 + c + b] = buf[b*n1 + j];
+        }
+        free(buf);
+    }
+
+    #pragma omp parallel if (n1*n2 > DST_OMP_GRAIN)
+    {
+        cplx_t* buf = (cplx_t*) malloc(n2 * sizeof(cplx_t));
+
+        #pragma omp for schedule(static)
+        for (k1 = 0; k1 < n1; ++k1)
+            fft_small(&t->p2, x + k1*n2, buf);
+        free(buf);
+    }
+
+    #pragma omp parallel for schedule(static) if (n1*n2 > DST_OMP_GRAIN)
+    for (i0 = 0; i0 < n1; i0 += DST_COLS) {
+        int i1 = (i0 + DST_COLS < n1) ? i0 + DST_COLS : n1;
+        int j0, i, j;
+
+        for (j0 = 0; j0 < n2; j0 += DST_COLS) {
+            int j1 = (j0 + DST_COLS < n2) ? j0 + DST_COLS : n2;
+            for (i = i0; i < i1; ++i)
+                for (j = j0; j < j1; ++j)
+                    work[i + n1*j] = x[i*n2 + j];
+        }
+    }
+    return work;
+}
+
+
+/* --
+ * DST-I of length n through a real FFT of length n, itself one complex
+ * FFT of length m = n/2 (Numerical Recipes' sinft).  With
+ *
+ *    y[j] = sin(pi j/n) (x[j] + x[n-j]) + (x[j] - x[n-j])/2,   y[0] = 0,
+ *
+ * and R + iI the transform sum_j y[j] exp(+2 pi i j k/n), the result is
+ * F[2k] = I[k], F[1] = R[0]/2, F[2k+1] = F[2k-1] + R[k].  The real FFT
+ * packs z[j] = y[2j] + i y[2j+1] and untangles Z[k], Z[m-k].
+ */
+typedef struct {
+    int n;
+    fft_t fft;
+    double* sn;     /* sin(pi j/n), j = 0 .. m */
+    cplx_t* wn;     /* exp(-2 pi i k/n), k = 0 .. m-1 */
+    cplx_t* z;
+    cplx_t* work;
+} dst_t;
+
+int dst_supported(int n)
+{
+    int f[DST_MAX_FACTORS];
+
+    return n >= 2 && n % 2 == 0 && fft_factor(n/2, f) >= 0;
+}
+
+static int dst_init(dst_t* d, int n)
+{
+    int j, m = n/2;
+
+    if (!dst_supported(n))
+        return -1;
+    fft_init(&d->fft, m);
+    d->n = n;
+    d->sn = (double*) malloc((m+1) * sizeof(double));
+    d->wn = (cplx_t*) malloc(m * sizeof(cplx_t));
+    d->z    = (cplx_t*) malloc(m * sizeof(cplx_t));
+    d->work = (cplx_t*) malloc(m * sizeof(cplx_t));
+    for (j = 0; j <= m; ++j)
+        d->sn[j] = sin(M_PI*j / n);
+    for (j = 0; j < m; ++j) {
+        d->wn[j].re =  cos(2*M_PI*j / n);
+        d->wn[j].im = -sin(2*M_PI*j / n);
+    }
+    return 0;
+}
+
+static void dst_free(dst_t* d)
+{
+    fft_free(&d->fft);
+    free(d->sn);
+    free(d->wn);
+    free(d->z);
+    free(d->work);
+}
+
+static void dst_run(dst_t* d, double* x)
+{
+    int j, k, n = d->n, m = n/2;
+    double* y = (double*) d->z;     /* y[2j], y[2j+1] are z[j] */
+    cplx_t* Z;
+
+    y[0] = 0;
+    #pragma omp parallel for schedule(static) if (m > DST_OMP_GRAIN)
+    for (j = 1; j <= m; ++j) {
+        double a = x[j], b = x[n-j];
+        double s = d->sn[j] * (a + b), t = 0.5 * (a - b);
+        y[j]   = s + t;
+        y[n-j] = s - t;
+    }
+
+    Z = fft_run(&d->fft, d->z, d->work);
+
+    /* x[2k] = I[k] and, for now, x[2k+1] = R[k] */
+    #pragma omp parallel for schedule(static) if (m > DST_OMP_GRAIN)
+    for (k = 0; k < m; ++k) {
+        cplx_t zk = Z[k], zc = Z[(m - k) % m];
+        cplx_t e, o, yk;
+        zc.im = -zc.im;
+        e  = cscale(cadd(zk, zc), 0.5);
+        o  = cscale(cmuli(csub(zk, zc)), 0.5);
+        yk = cadd(e, cmul(d->wn[k], o));
+        x[2*k]   = -yk.im;
+        x[2*k+1] =  yk.re;
+    }
+
+    /* Odd outputs are running sums */
+    x[0] = 0;
+    x[1] *= 0.5;
+    for (k = 1; k < m; ++k)
+        x[2*k+1] += x[2*k-1];
+}
+
+int dst1(int n, double* x)
+{
+    dst_t d;
+
+    if (dst_init(&d, n) < 0)
+        return -1;
+    dst_run(&d, x);
+    dst_free(&d);
+    return 0;
+}
+
+int dst_solve(int n, double* u, const double* f)
+{
+    int j;
+    double h2 = 1.0 / ((double) n * n);
+    double* x;
+    dst_t d;
+
+    if (dst_init(&d, n) < 0)
+        return -1;
+    x = (double*) calloc(n, sizeof(double));
+
+    /* Right side, with the boundary values moved over */
+    #pragma omp parallel for schedule(static) if (n > DST_OMP_GRAIN)
+    for (j = 1; j < n; ++j)
+        x[j] = h2 * f[j];
+    x[1]   += u[0];
+    x[n-1] += u[n];
+
+    /* u = (2/n) S diag(1/lambda) S x, lambda_k = 4 sin^2(pi k/(2n)) */
+    dst_run(&d, x);
+    #pragma omp parallel for schedule(static) if (n > DST_OMP_GRAIN)
+    for (j = 1; j < n; ++j) {
+        double s = sin(M_PI*j / (2.0*n));
+        x[j] /= 4*s*s;
+    }
+    dst_run(&d, x);
+
+    #pragma omp parallel for schedule(static) if (n > DST_OMP_GRAIN)
+    for (j = 1; j < n; ++j)
+        u[j] = x[j] * (2.0 / n);
+
+    free(x);
+    dst_free(&d);
+    return 0;
+}
@@ -3,22 +3,215 @@
 #include <string.h>
 #include <omp.h>
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "multigrid.h"
+#include "tridiag.h"
+#include "dst.h"
+#include "jacobi_topo.h"
+#include "jacobi_part.h"
+
+// Mínimo de puntos por bloque (JACOBI_GRAIN, en líneas de caché enteras)
+static int grain;
+
+// Bloque [lo, hi) de los índices [1, n) que le toca al hilo actual: los
+// bordes caen en un múltiplo de la línea de caché, así dos hilos nunca
+// escriben la misma línea (con pocos puntos los últimos hilos no reciben nada)
+static void static_range(int n, int* lo, int* hi) {
+    jacobi_part_range(n, omp_get_num_threads(), grain, omp_get_thread_num(), lo, hi);
+}
+
+// Gradiente conjugado (--solver cg / pcg) en una sola región paralela.
+// Cada iteración es una pasada de actualización y una del estencil que
+// además da los productos internos: dos barreras por iteración, una para
+// que los vecinos vean z y otra para juntar los parciales de cada hilo,
+// que todos los hilos suman en el mismo orden y así toman las mismas
+// decisiones.  Devuelve las iteraciones hechas
+static int cg_omp(int n, int niters, double* u, const double* f,
+                  const jacobi_opts_t* opts, jacobi_stats_t* stats) {
+    double h = 1.0 / n, h2 = h * h;
+    double dinv = (opts->solver == JACOBI_SOLVER_PCG) ? 0.5 : 1.0;
+    int nth = omp_get_max_threads();
+    double *r = jacobi_alloc(n+1);
+    double *w = jacobi_alloc(n+1);
+    double *p = jacobi_alloc(n+1);
+    double *s = jacobi_alloc(n+1);
+    double *z = (dinv != 1) ? jacobi_alloc(n+1) : r;
+    double *part = malloc(4*nth*sizeof(double));
+    int iters = 0;
+
+    memset(r, 0, (n+1)*sizeof(double));
+    memset(w, 0, (n+1)*sizeof(double));
+    memset(p, 0, (n+1)*sizeof(double));
+    memset(s, 0, (n+1)*sizeof(double));
+    memset(z, 0, (n+1)*sizeof(double));
+    #pragma omp parallel num_threads(nth)
+    {
+        int lo, hi, it, done = 0;
+        int tid = omp_get_thread_num(), nt = omp_get_num_threads();
+        double gamma = 0, alpha = 0, beta = 0;
+        jacobi_stats_t st = *stats;
+        static_range(n, &lo, &hi);
+
+        jacobi_cg_init(r, z, u, f, h2, dinv, lo, hi);
+        for(it = 0; ; it++) {
+            double *d = part + 4*tid, dots[4] = { 0, 0, 0, 0 };
+            if(it > 0)
+                jacobi_cg_update(u, r, z, p, s, w, alpha, beta, dinv, lo, hi);
+            // w = A z lee z[lo-1] y z[hi] del vecino
+            #pragma omp barrier
+            d[0] = d[1] = d[2] = d[3] = 0;
+            jacobi_cg_apply(w, z, r, h2, lo, hi, d);
+            #pragma omp barrier
+            for(int t = 0; t < nt; t++) {
+                dots[0] += part[4*t];
+                if(part[4*t+1] > dots[1]) dots[1] = part[4*t+1];
+                dots[2] += part[4*t+2];
+                dots[3] += part[4*t+3];
+            }
+            if(it > 0 && jacobi_check_due(opts, it))
+                done = jacobi_converged(opts, &st, it, dots, h);
+            if(done || it == niters) break;
+            jacobi_cg_step(dots, &gamma, &alpha, &beta);
+            // nadie pisa part hasta que todos lo sumaron: la próxima
+            // escritura viene después de la barrera de arriba
+        }
+        if(tid == 0) {
+            *stats = st;
+            iters = it;
+        }
+    }
+
+    if(z != r) free(z);
+    free(r); free(w); free(p); free(s); free(part);
+    return iters;
+}
+
+// Entero de una variable de entorno, o fallback si no está
+static int env_int(const char* name, int fallback) {
+    const char* env = getenv(name);
+    return env ? atoi(env) : fallback;
+}
+
+// Jacobi por tareas (JACOBI_TASKS=B): [1, n) se parte en bloques de B puntos
+// (bordes en líneas de caché) y cada (bloque, sweep) es una tarea que
+// depende de su bloque y de los dos vecinos en el sweep anterior, y de que
+// los lectores del sweep anterior hayan terminado con el bloque que pisa.
+// No hay barreras entre sweeps: varios quedan en vuelo como un frente de
+// onda.  Cada depth sweeps (JACOBI_TASK_DEPTH) se espera a todas las tareas,
+// lo que acota la cantidad de sweeps en vuelo; al cerrar un par con chequeo
+// también, para sumar los parciales por bloque.  Devuelve los sweeps hechos
+static int tasks_omp(int n, int nsteps, double* u, double* utmp, const double* f,
+                     int block, int depth, const jacobi_opts_t* opts,
+                     jacobi_stats_t* stats) {
+    double h = 1.0 / n, h2 = h * h;
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
+    jacobi_sweep_res_t sweep_res = jacobi_sweep_res_kernel();
+    int nblocks = (n + block - 1) / block;
+    double *norms = calloc(2*nblocks, sizeof(double));
+    int sweep = 0, done = 0;
+
+    #pragma omp parallel
+    #pragma omp single
+    {
+        for(sweep = 0; sweep < nsteps && !done; sweep++) {
+            // los sweeps pares van de u a utmp y los impares de utmp a u; el
+            // primero de un par con chequeo también mide el residuo
+            double *src = (sweep % 2 == 0) ? u : utmp;
+            double *dst = (sweep % 2 == 0) ? utmp : u;
+            int check = sweep % 2 == 0 && sweep < nsteps - 1 &&
+                        jacobi_check_due(opts, sweep);
+            for(int b = 0; b < nblocks; b++) {
+                int lo = (b == 0) ? 1 : b*block;
+                int hi = ((b+1)*block < n) ? (b+1)*block : n;
+                int left = (b > 0) ? ((b == 1) ? 1 : (b-1)*block) : lo;
+                int right = (b < nblocks-1) ? hi : lo;
+                double *nb = norms + 2*b;
+                #pragma omp task firstprivate(lo, hi, src, dst, check, nb) \
+                        depend(in: src[left], src[lo], src[right]) depend(out: dst[lo])
+                {
+                    if(check) {
+                        nb[0] = nb[1] = 0;
+                        sweep_res(dst, src, f, h2, lo, hi, nb);
+                    } else {
+                        half_sweep(dst, src, f, h2, lo, hi);
+                    }
+                }
+            }
+            if(sweep % 2 == 1 && jacobi_check_due(opts, sweep - 1)) {
+                // los bloques se suman en orden: misma decisión que siempre
+                double total[2];
+                #pragma omp taskwait
+                jacobi_sum_norms(norms, nblocks, total);
+                done = jacobi_converged(opts, stats, sweep - 1, total, h);
+            } else if((sweep + 1) % depth == 0) {
+                #pragma omp taskwait
+            }
+        }
+    }
+    // Con un número impar de sweeps el último quedó en utmp
+    if(sweep % 2 != 0)
+        memcpy(u + 1, utmp + 1, (n-1) * sizeof(double));
+    free(norms);
+    return sweep;
+}
 
 int main(int argc, char** argv) {
+    // --tol X, --check K, --solver S, --omega W y --error se pueden poner en cualquier lugar y se quitan de argv
+    jacobi_opts_t opts;
+    jacobi_stats_t stats = { 0, 0, 0, 0 };
+    jacobi_parse_opts(&argc, argv, &opts);
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_VCYCLE) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_FMG) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_WJACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_RBGS) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_SOR) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CHEBYSHEV) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_DIRECT) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_FFT) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CG) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_PCG));
+
     int n     = (argc > 1) ? atoi(argv[1]) : 100;
     int nsteps= (argc > 2) ? atoi(argv[2]) : 100;
     int num_threads = (argc > 3) ? atoi(argv[3]) : omp_get_max_threads();
     const char* fname = (argc > 4) ? argv[4] : NULL;
 
     omp_set_num_threads(num_threads);
+    grain = jacobi_grain();
+    // Modo por tareas: puntos por bloque (en líneas enteras) y sweeps en vuelo
+    int task_block = env_int("JACOBI_TASKS", 0);
+    int task_depth = env_int("JACOBI_TASK_DEPTH", 8);
+    if(task_block > 0)
+        task_block = (task_block + JACOBI_LINE_DOUBLES - 1) / JACOBI_LINE_DOUBLES * JACOBI_LINE_DOUBLES;
+    if(task_depth < 1)
+        task_depth = 1;
+
+    // Fijar cada hilo a un CPU según la topología (JACOBI_PLACE).  Con el
+    // reparto estático el hilo t barre el bloque t, y los CPUs vienen en
+    // orden de topología: bloques vecinos en núcleos que comparten caché.
+    // El equipo de hilos se reutiliza en las regiones siguientes
+    int place = jacobi_place_policy();
+    int *cpus = malloc(num_threads*sizeof(int));
+    jacobi_place(place, num_threads, cpus);
+    if(place != JACOBI_PLACE_NONE) {
+        #pragma omp parallel num_threads(num_threads)
+        jacobi_pin_self(cpus[omp_get_thread_num()]);
+    }
 
     double h  = 1.0 / n;
     double h2 = h * h;
+    double omega = jacobi_omega(&opts, n);
+    jacobi_sweep_t half_sweep = jacobi_kernel(n);
+    jacobi_fused_t fused_sweep = jacobi_use_fused() ? jacobi_fused_kernel() : NULL;
+    jacobi_sweep_res_t sweep_res = jacobi_sweep_res_kernel();
+    jacobi_fused_res_t fused_res = jacobi_fused_res_kernel();
 
-    // Reservar y inicializar
-    double *u    = malloc((n+1)*sizeof(double));
-    double *utmp = malloc((n+1)*sizeof(double));
-    double *f    = malloc((n+1)*sizeof(double));
+    // Reservar (alineados a línea de caché) e inicializar
+    double *u    = jacobi_alloc(n+1);
+    double *utmp = jacobi_alloc(n+1);
+    double *f    = jacobi_alloc(n+1);
     if(!u||!utmp||!f) { fprintf(stderr, "Error en malloc\n"); return EXIT_FAILURE; }
 
     memset(u, 0, (n+1)*sizeof(double));
@@ -32,22 +225,188 @@ int main(int argc, char** argv) {
     timing_t tstart, tend;
     get_time(&tstart);
 
-    // Iteraciones Jacobi
-    for(int step=0; step < nsteps; step++) {
-        // primer sweep
-        #pragma omp parallel for schedule(static)
-        for(int i=1; i<n; i++)
-            utmp[i] = (u[i-1] + u[i+1] + h2*f[i]) * 0.5;
-        // segundo sweep
-        #pragma omp parallel for schedule(static)
-        for(int i=1; i<n; i++)
-            u[i] = (utmp[i-1] + utmp[i+1] + h2*f[i]) * 0.5;
+    if(opts.solver == JACOBI_SOLVER_VCYCLE || opts.solver == JACOBI_SOLVER_FMG) {
+        // Multigrid: nsteps cuenta ciclos V y los lazos de multigrid.c se
+        // reparten entre los hilos con schedule(static)
+        mg_solve(n, u, f, opts.solver == JACOBI_SOLVER_FMG, nsteps, &opts, &stats);
+    } else if(opts.solver == JACOBI_SOLVER_DIRECT) {
+        // Thomas particionado: el último punto del bloque de cada hilo (menos
+        // el del último) es un separador.  Cada hilo resuelve el resto de su
+        // bloque con extremos en cero, un hilo resuelve el sistema chico de
+        // los separadores y cada hilo suma la recta entre sus separadores
+        int nparts = jacobi_part_count(n, num_threads, grain);
+        int *sep = malloc((nparts+1)*sizeof(int));
+        double *y = malloc((6*nparts+2)*sizeof(double));
+        sep[0] = 0;
+        #pragma omp parallel num_threads(nparts)
+        {
+            int tid = omp_get_thread_num();
+            int lo, hi;
+            static_range(n, &lo, &hi);
+            if(tid < nparts-1) hi--;
+            // utmp como espacio de trabajo
+            tridiag_block(u, f, h2, lo, hi, utmp);
+            y[2*tid]   = u[lo];
+            y[2*tid+1] = u[hi-1];
+            sep[tid+1] = hi;
+            #pragma omp barrier
+            #pragma omp single
+            {
+                double *x = y + 2*nparts, *fsep = x + nparts+1;
+                for(int q=0; q<=nparts; q++) {
+                    fsep[q] = f[sep[q]];
+                    x[q] = u[sep[q]];
+                }
+                tridiag_interface(nparts, sep, y, fsep, h2, x, fsep + nparts+1);
+                for(int q=1; q<nparts; q++) u[sep[q]] = x[q];
+            }
+            tridiag_correct(u, lo, hi, u[lo-1], u[hi]);
+        }
+        free(sep); free(y);
+    } else if(opts.solver == JACOBI_SOLVER_FFT) {
+        // Dos transformadas seno rápidas: los bloques de columnas y filas de
+        // la FFT y los lazos O(n) de dst.c se reparten entre los hilos
+        if(dst_solve(n, u, f) < 0) {
+            fprintf(stderr, "fft: n/2 = %d no es producto de 2, 3 y 5; se usa el solver directo\n", n/2);
+            tridiag_solve(n, u, f, utmp);
+        }
+    } else if(opts.solver == JACOBI_SOLVER_CG || opts.solver == JACOBI_SOLVER_PCG) {
+        // nsteps cuenta iteraciones de gradiente conjugado
+        stats.sweeps = cg_omp(n, nsteps, u, f, &opts, &stats);
+    } else if(task_block > 0 && opts.solver == JACOBI_SOLVER_JACOBI) {
+        // Jacobi como frente de onda de tareas, sin barreras entre sweeps
+        stats.sweeps = tasks_omp(n, nsteps, u, utmp, f, task_block, task_depth,
+                                 &opts, &stats);
+    } else {
+        // Iteraciones Jacobi (o Jacobi amortiguado / Gauss-Seidel / SOR /
+        // Chebyshev) en una sola región paralela: cada hilo se queda con su
+        // bloque estático para toda la corrida y los sweeps se separan con
+        // barreras explícitas.  nsteps cuenta sweeps, como en la versión
+        // secuencial: de a dos y, si nsteps es impar, uno más al final
+        int nth = omp_get_max_threads();
+        double *partials = calloc(4*nth, sizeof(double));
+        jacobi_stats_t st = stats;
+        #pragma omp parallel num_threads(nth) firstprivate(st)
+        {
+            int lo, hi, sweep, color, check, flags, done = 0;
+            int tid = omp_get_thread_num(), nt = omp_get_num_threads();
+            double halo[4], total[2];
+            double *parts = partials, *norms = partials;
+            double w = omega;  // peso de Chebyshev: cada hilo lo calcula igual
+            static_range(n, &lo, &hi);
+            for(sweep = 0; sweep < nsteps - 1 && !done; sweep += 2) {
+                // cada tanto el primer sweep también mide el residuo.  Los
+                // chequeos seguidos alternan entre dos juegos de parciales,
+                // así un hilo rápido no pisa valores que otro está sumando
+                check = jacobi_check_due(&opts, sweep);
+                if(check) {
+                    parts = partials + 2*nt*(sweep / opts.check % 2);
+                    norms = parts + 2*tid;
+                    norms[0] = norms[1] = 0;
+                }
+                if(opts.solver == JACOBI_SOLVER_WJACOBI) {
+                    // Jacobi amortiguado: u -> utmp, barrera, utmp -> u
+                    jacobi_weighted_sweep(utmp, u, f, h2, omega, lo, hi,
+                                          check ? norms : NULL);
+                    #pragma omp barrier
+                    jacobi_weighted_sweep(u, utmp, f, h2, omega, lo, hi, NULL);
+                } else if(opts.solver == JACOBI_SOLVER_CHEBYSHEV) {
+                    // Chebyshev: igual que el anterior, pero utmp y u guardan
+                    // también la iteración previa y el peso cambia en cada sweep
+                    w = jacobi_chebyshev_omega(n, sweep, w);
+                    jacobi_chebyshev_sweep(utmp, u, f, h2, w, lo, hi,
+                                           check ? norms : NULL);
+                    #pragma omp barrier
+                    w = jacobi_chebyshev_omega(n, sweep + 1, w);
+                    jacobi_chebyshev_sweep(u, utmp, f, h2, w, lo, hi, NULL);
+                } else if(opts.solver != JACOBI_SOLVER_JACOBI) {
+                    // Gauss-Seidel / SOR rojo-negro sobre u: el residuo se mide
+                    // antes de tocar u, luego rojo, negro, rojo, negro
+                    if(check) {
+                        jacobi_residual(u, f, h2, lo, hi, norms);
+                        #pragma omp barrier
+                    }
+                    for(color = 0; color < 4; color++) {
+                        if(color > 0) {
+                            #pragma omp barrier
+                        }
+                        jacobi_rb_sweep(u, f, h2, omega, lo, hi, color & 1);
+                    }
+                } else if(fused_sweep) {
+                    // ambos sweeps en una pasada sobre u: nadie sobrescribe u
+                    // hasta que todos guardaron sus vecinos
+                    flags = jacobi_halo(u, lo, hi, lo == 1, hi == n, halo);
+                    #pragma omp barrier
+                    if(check)
+                        fused_res(u, f, h2, lo, hi, halo, flags, norms);
+                    else
+                        fused_sweep(u, f, h2, lo, hi, halo, flags);
+                } else {
+                    // primer sweep u -> utmp, barrera, segundo sweep utmp -> u
+                    if(check)
+                        sweep_res(utmp, u, f, h2, lo, hi, norms);
+                    else
+                        half_sweep(utmp, u, f, h2, lo, hi);
+                    #pragma omp barrier
+                    half_sweep(u, utmp, f, h2, lo, hi);
+                }
+                #pragma omp barrier
+                // todos suman los parciales en el mismo orden y toman la
+                // misma decisión
+                if(check) {
+                    jacobi_sum_norms(parts, nt, total);
+                    done = jacobi_converged(&opts, &st, sweep, total, h);
+                }
+            }
+            // si nsteps es impar, un sweep más
+            if(nsteps % 2 != 0 && !done) {
+                if(opts.solver == JACOBI_SOLVER_RBGS || opts.solver == JACOBI_SOLVER_SOR) {
+                    // rojo-negro: un color, barrera y el otro
+                    jacobi_rb_sweep(u, f, h2, omega, lo, hi, 0);
+                    #pragma omp barrier
+                    jacobi_rb_sweep(u, f, h2, omega, lo, hi, 1);
+                } else {
+                    if(opts.solver == JACOBI_SOLVER_WJACOBI) {
+                        jacobi_weighted_sweep(utmp, u, f, h2, omega, lo, hi, NULL);
+                    } else if(opts.solver == JACOBI_SOLVER_CHEBYSHEV) {
+                        w = jacobi_chebyshev_omega(n, sweep, w);
+                        jacobi_chebyshev_sweep(utmp, u, f, h2, w, lo, hi, NULL);
+                    } else {
+                        half_sweep(utmp, u, f, h2, lo, hi);
+                    }
+                    // cada hilo copia solo su bloque: los vecinos ya no leen u
+                    #pragma omp barrier
+                    memcpy(u + lo, utmp + lo, (hi - lo) * sizeof(double));
+                }
+                sweep++;
+            }
+            if(tid == 0) {
+                st.sweeps = sweep;
+                stats = st;
+            }
+        }
+        free(partials);
     }
 
     get_time(&tend);
 
-    printf("n: %d\nnsteps: %d\nnum_threads: %d\nElapsed time: %Lf s\n",
-           n, nsteps, num_threads, timespec_diff(tstart, tend));
+    printf("n: %d\nnsteps: %d\nnum_threads: %d\nsolver: %s\nsweep: %s\nkernel: %s\nElapsed time: %Lf s\n",
+           n, nsteps, num_threads, jacobi_solver_name(opts.solver),
+           fused_sweep ? "fused" : "split",
+           jacobi_kernel_name(half_sweep),
+           timespec_diff(tstart, tend));
+    jacobi_place_print(place, num_threads, cpus);
+    {
+        // Puntos de cada hilo en los barridos
+        int *bounds = malloc((num_threads+1)*sizeof(int));
+        jacobi_partition(n, num_threads, grain, bounds);
+        jacobi_part_print(num_threads, bounds);
+        free(bounds);
+    }
+    if(task_block > 0 && opts.solver == JACOBI_SOLVER_JACOBI)
+        printf("tasks: bloques de %d puntos, %d sweeps en vuelo\n", task_block, task_depth);
+    jacobi_print_stats(&opts, &stats);
+    if(opts.error) printf("error vs direct: %g\n", tridiag_error(n, u, f));
 
     if(fname) {
         FILE* fp = fopen(fname, "w");
@@ -55,6 +414,6 @@ int main(int argc, char** argv) {
         fclose(fp);
     }
 
-    free(u); free(utmp); free(f);
+    free(u); free(utmp); free(f); free(cpus);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jacobi_opts.h"
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+static const char* solver_names[JACOBI_NUM_SOLVERS] = {
+    "jacobi", "vcycle", "fmg", "wjacobi", "rbgs", "sor",
+    "chebyshev", "direct", "fft", "cg", "pcg"
+};
+
+static int parse_solver(const char* name)
+{
+    int s;
+
+    for (s = 0; s < JACOBI_NUM_SOLVERS; ++s)
+        if (strcmp(name, solver_names[s]) == 0)
+            return s;
+    fprintf(stderr, "Unknown solver '%s'; expected one of:", name);
+    for (s = 0; s < JACOBI_NUM_SOLVERS; ++s)
+        fprintf(stderr, " %s", solver_names[s]);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+void jacobi_parse_opts(int* argc, char** argv, jacobi_opts_t* opts)
+{
+    int i, j;
+
+    opts->tol   = 0;
+    opts->check = 0;
+    opts->solver = JACOBI_SOLVER_JACOBI;
+    opts->omega  = 0;
+    opts->error  = 0;
+    for (i = j = 1; i < *argc; ++i) {
+        if (strcmp(argv[i], "--tol") == 0 && i+1 < *argc)
+            opts->tol = atof(argv[++i]);
+        else if (strcmp(argv[i], "--check") == 0 && i+1 < *argc)
+            opts->check = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--solver") == 0 && i+1 < *argc)
+            opts->solver = parse_solver(argv[++i]);
+        else if (strcmp(argv[i], "--omega") == 0 && i+1 < *argc)
+            opts->omega = atof(argv[++i]);
+        else if (strcmp(argv[i], "--error") == 0)
+            opts->error = 1;
+        else
+            argv[j++] = argv[i];
+    }
+    *argc = j;
+    argv[j] = NULL;
+
+    if (opts->tol > 0 && opts->check <= 0)
+        opts->check = JACOBI_DEFAULT_CHECK;
+    if (opts->check < 0)
+        opts->check = 0;
+
+    /* Checks land on the first half of a fused sweep pair */
+    opts->check += opts->check % 2;
+}
+
+const char* jacobi_solver_name(int solver)
+{
+    return (solver >= 0 && solver < JACOBI_NUM_SOLVERS) ?
+        solver_names[solver] : "unknown";
+}
+
+double jacobi_omega(const jacobi_opts_t* opts, int n)
+{
+    if (opts->omega > 0)
+        return opts->omega;
+    switch (opts->solver) {
+    case JACOBI_SOLVER_WJACOBI:
+        return 2.0/3.0;
+    case JACOBI_SOLVER_SOR:
+        return 2.0 / (1.0 + sin(M_PI / n));
+    default:
+        return 1.0;
+    }
+}
+
+double jacobi_chebyshev_omega(int n, int sweep, double prev)
+{
+    double rho = cos(M_PI / n);
+
+    if (sweep == 0)
+        return 1.0;
+    if (sweep == 1)
+        return 1.0 / (1.0 - rho*rho/2);
+    return 1.0 / (1.0 - rho*rho*prev/4);
+}
+
+void jacobi_require_solvers(const jacobi_opts_t* opts, unsigned mask)
+{
+    if (!(mask & JACOBI_SOLVER_MASK(opts->solver))) {
+        fprintf(stderr, "Solver '%s' is not available in this version\n",
+                jacobi_solver_name(opts->solver));
+        exit(EXIT_FAILURE);
+    }
+}
+
+int jacobi_check_due(const jacobi_opts_t* opts, int sweep)
+{
+    return opts && opts->check > 0 && sweep % opts->check == 0;
+}
+
+int jacobi_converged(const jacobi_opts_t* opts, jacobi_stats_t* stats,
+                     int sweep, const double norms[2], double h)
+{
+    stats->checked  = sweep;
+    stats->res_l2   = sqrt(h * norms[0]);
+    stats->res_linf = norms[1];
+    return opts->tol > 0 && stats->res_l2 <= opts->tol;
+}
+
+void jacobi_sum_norms(const double* partials, int nparts, double norms[2])
+{
+    int i;
+
+    norms[0] = norms[1] = 0;
+    for (i = 0; i < nparts; ++i) {
+        norms[0] += partials[2*i];
+        if (partials[2*i+1] > norms[1])
+            norms[1] = partials[2*i+1];
+    }
+}
+
+void jacobi_print_stats(const jacobi_opts_t* opts,
+                        const jacobi_stats_t* stats)
+{
+    if (opts->check == 0)
+        return;
+    printf("tol: %g\n"
+           "iterations: %d\n"
+           "residual L2: %g\n"
+           "residual Linf: %g\n"
+           "residual at sweep: %d\n",
+           opts->tol, stats->sweeps, stats->res_l2, stats->res_linf,
+           stats->checked);
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jacobi_part.h"
+
+int jacobi_grain(void)
+{
+    const char* env = getenv("JACOBI_GRAIN");
+    int grain = (env != NULL) ? atoi(env) : 0;
+
+    if (grain < JACOBI_LINE_DOUBLES)
+        return JACOBI_LINE_DOUBLES;
+    return (grain + JACOBI_LINE_DOUBLES - 1) / JACOBI_LINE_DOUBLES * JACOBI_LINE_DOUBLES;
+}
+
+int jacobi_part_count(int n, int nparts, int grain)
+{
+    int m = (n - 1) / grain;
+
+    if (m < 1)
+        m = 1;
+    return (m < nparts) ? m : nparts;
+}
+
+/* --
+ * Start of chunk k of m: the even split 1 + (n-1) k / m rounded to the
+ * nearest line.  Consecutive even starts are at least a grain (so at
+ * least a line) apart, hence the rounded ones stay strictly increasing
+ * and inside (1, n).
+ */
+static int part_bound(int n, int m, int k)
+{
+    long b;
+
+    if (k <= 0)
+        return 1;
+    if (k >= m)
+        return n;
+    b = 1 + (long) (n - 1) * k / m;
+    b = (b + JACOBI_LINE_DOUBLES / 2) / JACOBI_LINE_DOUBLES * JACOBI_LINE_DOUBLES;
+    return (int) b;
+}
+
+void jacobi_partition(int n, int nparts, int grain, int* bounds)
+{
+    int k, m = jacobi_part_count(n, nparts, grain);
+
+    for (k = 0; k <= nparts; ++k)
+        bounds[k] = part_bound(n, m, k);
+}
+
+void jacobi_part_range(int n, int nparts, int grain, int k, int* lo, int* hi)
+{
+    int m = jacobi_part_count(n, nparts, grain);
+
+    *lo = part_bound(n, m, k);
+    *hi = part_bound(n, m, k + 1);
+}
+
+int jacobi_part_min(int nparts, const int* bounds)
+{
+    int k, least = bounds[1] - bounds[0];
+
+    for (k = 1; k < nparts; ++k)
+        if (bounds[k+1] - bounds[k] < least)
+            least = bounds[k+1] - bounds[k];
+    return least;
+}
+
+void jacobi_part_print(int nparts, const int* bounds)
+{
+    int k, most = 0;
+
+    printf("work:");
+    for (k = 0; k < nparts; ++k) {
+        printf(" %d", bounds[k+1] - bounds[k]);
+        if (bounds[k+1] - bounds[k] > most)
+            most = bounds[k+1] - bounds[k];
+    }
+    printf(" (max/mean %.3f)\n", (bounds[nparts] > bounds[0])
+           ? (double) most * nparts / (bounds[nparts] - bounds[0]) : 1.0);
+}
+
+int jacobi_part_balance(int n, int nparts, int grain, const double* busy,
+                        int* bounds)
+{
+    double total = 0, before = 0, after = 0, acc = 0, speed, target;
+    int k, b, lo, hi, changed = 0;
+    int* next = (int*) malloc((nparts + 1) * sizeof(int));
+
+    /* Points per second of every chunk; give up on a chunk without time */
+    for (k = 0; k < nparts; ++k) {
+        if (busy[k] <= 0) {
+            free(next);
+            return 0;
+        }
+        total += (bounds[k+1] - bounds[k]) / busy[k];
+        if (busy[k] > before)
+            before = busy[k];
+    }
+    next[0] = 1;
+    next[nparts] = n;
+    for (k = 1; k < nparts; ++k) {
+        acc += (bounds[k] - bounds[k-1]) / busy[k-1];
+        target = 1 + (n - 1) * acc / total;
+        b = (int) (target + JACOBI_LINE_DOUBLES / 2) / JACOBI_LINE_DOUBLES * JACOBI_LINE_DOUBLES;
+        /* At least a grain for this chunk and for each one after it */
+        lo = (next[k-1] + grain + JACOBI_LINE_DOUBLES - 1) / JACOBI_LINE_DOUBLES * JACOBI_LINE_DOUBLES;
+        hi = (n - (nparts - k) * grain) / JACOBI_LINE_DOUBLES * JACOBI_LINE_DOUBLES;
+        if (lo > hi) {
+            free(next);
+            return 0;
+        }
+        if (b > hi)
+            b = hi;
+        if (b < lo)
+            b = lo;
+        next[k] = b;
+    }
+    /* Predicted time of the slowest chunk at the measured speeds */
+    for (k = 0; k < nparts; ++k) {
+        speed = (bounds[k+1] - bounds[k]) / busy[k];
+        if ((next[k+1] - next[k]) / speed > after)
+            after = (next[k+1] - next[k]) / speed;
+    }
+    if (after < (1 - JACOBI_BALANCE_GAIN) * before) {
+        for (k = 1; k < nparts; ++k)
+            changed |= (bounds[k] != next[k]);
+        memcpy(bounds, next, (nparts + 1) * sizeof(int));
+    }
+    free(next);
+    return changed;
+}
+
+int jacobi_balance_window(void)
+{
+    const char* env = getenv("JACOBI_BALANCE");
+    int w = (env != NULL) ? atoi(env) : 0;
+
+    return (w > 0) ? (w + 1) / 2 * 2 : 0;
+}
+
+double* jacobi_alloc(size_t count)
+{
+    size_t bytes = (count * sizeof(double) + JACOBI_LINE - 1) / JACOBI_LINE * JACOBI_LINE;
+    return (double*) aligned_alloc(JACOBI_LINE, bytes);
+}
@@ -0,0 +1,69 @@
+#ifndef JACOBI_PART_H_
+#define JACOBI_PART_H_
+
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * Partition of the interior points [1, n) among the workers of a run.
+ * The arrays come from jacobi_alloc() and start on a cache line, so point
+ * i lives in line i / JACOBI_LINE_DOUBLES; every boundary between two
+ * chunks is a multiple of JACOBI_LINE_DOUBLES, and no two workers ever
+ * write the same line of u or utmp.  Chunks get at least about the grain
+ * (JACOBI_GRAIN points, one line by default and never less): with fewer
+ * points than that per worker the trailing workers get empty chunks
+ * [n, n) instead of a sliver each.
+ */
+#define JACOBI_LINE 64
+#define JACOBI_LINE_DOUBLES (JACOBI_LINE / (int) sizeof(double))
+
+/* Grain from JACOBI_GRAIN, rounded up to whole cache lines */
+int jacobi_grain(void);
+
+/* Number of workers whose chunk is not empty */
+int jacobi_part_count(int n, int nparts, int grain);
+
+/* --
+ * bounds[k] .. bounds[k+1] is the chunk of worker k (nparts+1 entries,
+ * bounds[0] = 1 and bounds[nparts] = n).
+ */
+void jacobi_partition(int n, int nparts, int grain, int* bounds);
+
+/* Chunk [*lo, *hi) of worker k alone, the same as jacobi_partition() */
+void jacobi_part_range(int n, int nparts, int grain, int k, int* lo, int* hi);
+
+/* Points in the smallest chunk (for jacobi_sync_init) */
+int jacobi_part_min(int nparts, const int* bounds);
+
+/* Print "work: <points of each worker> (max/mean <imbalance>)" */
+void jacobi_part_print(int nparts, const int* bounds);
+
+/* --
+ * Adaptive balancing: busy[k] is the time worker k spent computing its
+ * chunk bounds[k] .. bounds[k+1] over the last window.  Moves the bounds
+ * of the first nparts (non-empty) chunks so that each gets points in
+ * proportion to its measured speed, keeping them contiguous, on cache
+ * lines and at least a grain long.  Nothing changes unless the
+ * predicted slowest chunk gets at least JACOBI_BALANCE_GAIN faster.
+ * Returns 1 if the bounds moved.  Deterministic: workers that call it
+ * with the same busy[] all get the same bounds.
+ */
+#define JACOBI_BALANCE_GAIN 0.05
+
+int jacobi_part_balance(int n, int nparts, int grain, const double* busy,
+                        int* bounds);
+
+/* Balancing window from JACOBI_BALANCE (sweeps, even; 0 = static split) */
+int jacobi_balance_window(void);
+
+/* count doubles starting on a cache line; release with free() */
+double* jacobi_alloc(size_t count);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* JACOBI_PART_H_ */
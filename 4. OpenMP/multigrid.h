@@ -0,0 +1,79 @@
+#ifndef MULTIGRID_H_
+#define MULTIGRID_H_
+
+#include "jacobi_opts.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * Geometric multigrid for the same 1D problem -u'' = f on [0,1].
+ *
+ * Level l has n_l = n / 2^l intervals; coarse point I sits on fine
+ * point 2I.  Levels are added while n_l is even, so n with many factors
+ * of two gives the deepest hierarchy; the coarsest level is solved
+ * exactly with the Thomas algorithm.  A V-cycle costs a few passes over
+ * the fine grid and reduces the error by a fixed factor independent of
+ * n, so the solver reaches discretization-level accuracy in O(n) work
+ * instead of the O(n^2) sweeps plain Jacobi needs.
+ *
+ * The loops carry OpenMP pragmas with static scheduling (the same block
+ * split as the sweep drivers); without -fopenmp they run sequentially.
+ */
+
+/* Damped Jacobi weight: 2/3 damps the upper half of the spectrum best */
+#define MG_OMEGA (2.0/3.0)
+
+/* Smoothing sweeps before and after the coarse-grid correction (even) */
+#define MG_PRE_SWEEPS  2
+#define MG_POST_SWEEPS 2
+
+#define MG_MAX_LEVELS 40
+
+/* --
+ * Building blocks, shared with the distributed version in the MPI
+ * driver.  Like the sweep kernels they work on an index range [lo, hi)
+ * and read one neighbour on each side.  off maps coarse index I to fine
+ * index 2I + off, so blocks with ghost cells can use them too (off = 0
+ * for whole levels).
+ */
+
+/* dst = src + omega*(Jacobi update of src - src) over [lo, hi) */
+void mg_smooth(double* dst, const double* src, const double* f,
+               double h2, int lo, int hi);
+
+/* --
+ * r = f + u'' over [lo, hi).  If norms is not NULL, also accumulate
+ * norms[0] += sum r^2 and norms[1] = max(norms[1], |r|).
+ */
+void mg_residual(double* r, const double* u, const double* f,
+                 double h2, int lo, int hi, double norms[2]);
+
+/* Full weighting: fc[I] = (r[2I-1] + 2 r[2I] + r[2I+1]) / 4, I in [lo, hi) */
+void mg_restrict(double* fc, const double* r, int lo, int hi, int off);
+
+/* Linear interpolation of e added to fine points u[lo .. hi) */
+void mg_prolong(double* u, const double* e, int lo, int hi, int off);
+
+/* --
+ * Exact solve of the n-interval problem with Dirichlet values u[0] and
+ * u[n] (tridiag_solve(), the Thomas algorithm).  work holds at least
+ * n+1 doubles.
+ */
+void mg_direct(int n, double* u, const double* f, double* work);
+
+/* --
+ * Solve with up to maxcycles V-cycles (after one FMG pass if fmg is
+ * set).  With residual checks on (opts->check > 0) the residual is
+ * measured after every cycle and the solve stops once it is below
+ * opts->tol.  Returns the number of cycles, also left in stats->sweeps.
+ */
+int mg_solve(int n, double* u, double* f, int fmg, int maxcycles,
+             const jacobi_opts_t* opts, jacobi_stats_t* stats);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* MULTIGRID_H_ */
@@ -0,0 +1,108 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "tridiag.h"
+
+/* Thomas algorithm over [lo, hi) with u[lo-1] = left and u[hi] = right */
+static void thomas(double* u, const double* f, double h2, int lo, int hi,
+                   double left, double right, double* work)
+{
+    int i;
+
+    if (hi <= lo)
+        return;
+
+    /* Forward elimination; work[i] keeps the inverse pivot, u[i] the
+     * modified right side */
+    work[lo] = 0.5;
+    u[lo] = (h2*f[lo] + left) * work[lo];
+    for (i = lo+1; i < hi; ++i) {
+        work[i] = 1.0 / (2.0 - work[i-1]);
+        u[i] = (h2*f[i] + u[i-1]) * work[i];
+    }
+    u[hi-1] += right * work[hi-1];
+
+    /* Back substitution */
+    for (i = hi-2; i >= lo; --i)
+        u[i] += u[i+1] * work[i];
+}
+
+void tridiag_solve(int n, double* u, const double* f, double* work)
+{
+    double h2 = 1.0 / ((double) n * n);
+
+    thomas(u, f, h2, 1, n, u[0], u[n], work);
+}
+
+void tridiag_block(double* u, const double* f, double h2,
+                   int lo, int hi, double* work)
+{
+    thomas(u, f, h2, lo, hi, 0, 0, work);
+}
+
+void tridiag_interface(int nparts, const int* sep, const double* y,
+                       const double* fsep, double h2, double* x,
+                       double* work)
+{
+    int q;
+    double* cp = work;
+    double* dp = work + nparts;
+
+    /* Row q couples the separator to its neighbours through the parts on
+     * either side: u[sep[q] -/+ 1] is y plus the line between separators */
+    for (q = 1; q < nparts; ++q) {
+        int lm = sep[q] - sep[q-1];
+        int lp = sep[q+1] - sep[q];
+        double a = -1.0 / lm, b = 1.0/lm + 1.0/lp, c = -1.0 / lp;
+        double d = h2*fsep[q];
+
+        if (lm > 1)
+            d += y[2*(q-1) + 1];
+        if (lp > 1)
+            d += y[2*q];
+        if (q == 1)
+            d -= a * x[0];
+        if (q == nparts-1)
+            d -= c * x[nparts];
+
+        if (q == 1) {
+            cp[q] = c / b;
+            dp[q] = d / b;
+        } else {
+            double m = b - a*cp[q-1];
+            cp[q] = c / m;
+            dp[q] = (d - a*dp[q-1]) / m;
+        }
+    }
+
+    for (q = nparts-1; q >= 1; --q)
+        x[q] = (q == nparts-1) ? dp[q] : dp[q] - cp[q]*x[q+1];
+}
+
+void tridiag_correct(double* u, int lo, int hi, double left, double right)
+{
+    int i;
+    double s = 1.0 / (hi - lo + 1);
+
+    for (i = lo; i < hi; ++i)
+        u[i] += (left*(hi - i) + right*(i - lo + 1)) * s;
+}
+
+double tridiag_error(int n, const double* u, const double* f)
+{
+    int i;
+    double err = 0;
+    double* ref  = (double*) malloc((n+1) * sizeof(double));
+    double* work = (double*) malloc((n+1) * sizeof(double));
+
+    ref[0] = u[0];
+    ref[n] = u[n];
+    tridiag_solve(n, ref, f, work);
+    for (i = 1; i < n; ++i)
+        if (fabs(u[i] - ref[i]) > err)
+            err = fabs(u[i] - ref[i]);
+
+    free(work);
+    free(ref);
+    return err;
+}
@@ -98,6 +98,84 @@ for P in "${PROCESSES[@]}"; do
   echo "=================================================="
 done
 
+# Modos de comunicación (JACOBI_COMM): esperar antes de barrer, solapar con
+# el interior o con un hilo de comunicación, con 4 procesos en las 4 máquinas
+OUTFILE="resultados_benchmark_mpi_comm.csv"
+echo "N,NSTEPS,COMM,TIEMPO(s)" > "$OUTFILE"
+for N in "${N_VALUES[@]}"; do
+  for COMM in wait overlap thread; do
+    printf "COMM=%-8s N=%-8s -> " "$COMM" "$N"
+    TIEMPO=$(mpirun -np 4 -host head,wn1,wn2,wn3 -x JACOBI_COMM=$COMM ./jacobi1d_mpi_openmp $N 1000 $THREADS_PER_PROCESS 2>&1 | grep "Elapsed time" | awk '{print $3}')
+    echo "$TIEMPO s"
+    echo "$N,1000,$COMM,$TIEMPO" >> "$OUTFILE"
+    sleep 2
+  done
+done
+echo "Comparacion de modos de comunicacion en: $OUTFILE"
+
+# Celdas fantasma profundas (JACOBI_GHOST): un intercambio cada k sweeps;
+# auto elige k con el modelo de latencia
+OUTFILE="resultados_benchmark_mpi_ghost.csv"
+echo "N,NSTEPS,GHOST,TIEMPO(s)" > "$OUTFILE"
+for N in 10000 100000; do
+  for GHOST in 1 4 16 64 auto; do
+    printf "GHOST=%-5s N=%-8s -> " "$GHOST" "$N"
+    TIEMPO=$(mpirun -np 4 -host head,wn1,wn2,wn3 -x JACOBI_GHOST=$GHOST ./jacobi1d_mpi_openmp $N 5000 $THREADS_PER_PROCESS 2>&1 | grep "Elapsed time" | awk '{print $3}')
+    echo "$TIEMPO s"
+    echo "$N,5000,$GHOST,$TIEMPO" >> "$OUTFILE"
+    sleep 2
+  done
+done
+echo "Comparacion de celdas fantasma en: $OUTFILE"
+
+# Implementación del intercambio (JACOBI_HALO) con bloques chicos y muchos
+# pasos, donde pesa el costo de cada llamada a MPI
+OUTFILE="resultados_benchmark_mpi_halo.csv"
+echo "N,NSTEPS,HALO,TIEMPO(s)" > "$OUTFILE"
+for N in 1000 10000; do
+  for HALO in p2p persistent neighbor; do
+    printf "HALO=%-10s N=%-8s -> " "$HALO" "$N"
+    TIEMPO=$(mpirun -np 4 -host head,wn1,wn2,wn3 -x JACOBI_HALO=$HALO ./jacobi1d_mpi_openmp $N 20000 $THREADS_PER_PROCESS 2>&1 | grep "Elapsed time" | awk '{print $3}')
+    echo "$TIEMPO s"
+    echo "$N,20000,$HALO,$TIEMPO" >> "$OUTFILE"
+    sleep 2
+  done
+done
+echo "Comparacion de intercambios en: $OUTFILE"
+
+# Memoria compartida entre procesos del mismo nodo (JACOBI_HALO=shm): los 4
+# procesos en head, contra mensajes persistentes
+OUTFILE="resultados_benchmark_mpi_shm.csv"
+echo "N,NSTEPS,HALO,TIEMPO(s)" > "$OUTFILE"
+for N in 1000 10000; do
+  for HALO in persistent shm; do
+    printf "HALO=%-10s N=%-8s -> " "$HALO" "$N"
+    TIEMPO=$(mpirun -np 4 -host head:4 -x JACOBI_HALO=$HALO ./jacobi1d_mpi_openmp $N 20000 1 2>&1 | grep "Elapsed time" | awk '{print $3}')
+    echo "$TIEMPO s"
+    echo "$N,20000,$HALO,$TIEMPO" >> "$OUTFILE"
+    sleep 2
+  done
+done
+echo "Comparacion de memoria compartida en: $OUTFILE"
+
+# Escritura de la solución (JACOBI_OUTPUT) con un n grande y pocos pasos:
+# gather junta todo en el proceso 0, binary y text escriben con MPI-IO
+OUTFILE="resultados_benchmark_mpi_output.csv"
+echo "N,PROCESOS,OUTPUT,TIEMPO_ESCRITURA(s)" > "$OUTFILE"
+N=10000000
+for HOSTS in head head,wn1 head,wn1,wn2,wn3; do
+  P=$(echo "$HOSTS" | tr ',' '\n' | wc -l)
+  for OUT in gather binary text; do
+    printf "OUTPUT=%-7s P=%-2s -> " "$OUT" "$P"
+    TIEMPO=$(mpirun -np $P -host $HOSTS -x JACOBI_OUTPUT=$OUT ./jacobi1d_mpi_openmp $N 10 $THREADS_PER_PROCESS u_benchmark.out 2>&1 | grep "^output:" | tr -d '()' | awk '{print $3}')
+    echo "$TIEMPO s"
+    echo "$N,$P,$OUT,$TIEMPO" >> "$OUTFILE"
+    rm -f u_benchmark.out
+    sleep 2
+  done
+done
+echo "Comparacion de escritura en: $OUTFILE"
+
 echo ""
 echo "BENCHMARK COMPLETO FINALIZADO"
 echo "Hora de finalizacion: $(date)"
@@ -1,17 +1,1063 @@
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <omp.h>
 #include <mpi.h>
 #include "timing.h"
+#include "jacobi_kernels.h"
+#include "jacobi_opts.h"
+#include "multigrid.h"
+#include "tridiag.h"
 
-int main(int argc, char** argv) {
+// Celdas fantasma a cada lado del bloque local: dos, para que el kernel
+// fusionado tenga u[lo-2], u[lo-1], u[hi] y u[hi+1] del vecino
+#define NG 2
+
+// Parte [tlo, thi) del rango local [lo, hi) que le toca al hilo OpenMP actual
+static void thread_range(int lo, int hi, int* tlo, int* thi) {
+    int tid = omp_get_thread_num();
+    int nth = omp_get_num_threads();
+    *tlo = lo + (int) ((long) (hi - lo) * tid / nth);
+    *thi = lo + (int) ((long) (hi - lo) * (tid + 1) / nth);
+}
+
+// ---------------------------------------------------------------------
+// Intercambio de celdas fantasma preparado una sola vez.  Los procesos
+// forman una topología cartesiana 1D (MPI_Cart_create sin reordenar, así
+// el rango es el mismo que en MPI_COMM_WORLD) y MPI_Cart_shift da los
+// vecinos, MPI_PROC_NULL en los extremos.  JACOBI_HALO elige cómo se
+// mueven los bordes:
+//    persistent  (por defecto) MPI_Send_init/MPI_Recv_init por cada arreglo
+//                y ancho, creados la primera vez que se usan y reiniciados
+//                con MPI_Startall en cada intercambio
+//    neighbor    MPI_Ineighbor_alltoall sobre la topología, con los bordes
+//                copiados a un búfer chico
+//    p2p         MPI_Isend/MPI_Irecv nuevos en cada intercambio
+//    shm         entre procesos del mismo nodo, memoria compartida (ver
+//                abajo); con los de otros nodos, como persistent
+// halo_start() inicia el intercambio y halo_finish() lo espera (en neighbor
+// y shm además copia lo recibido a las celdas fantasma); entre los dos se
+// puede calcular lo que no lee celdas fantasma.  Solo lo llama el hilo 0.
+//
+// En modo shm los procesos de cada nodo (MPI_Comm_split_type con
+// MPI_COMM_TYPE_SHARED) reservan u y utmp en una ventana de
+// MPI_Win_allocate_shared, un segmento por proceso con el mismo formato,
+// así el arreglo del vecino está en su segmento a la misma distancia del
+// comienzo.  El segmento empieza con dos contadores de intercambios, cada
+// uno en su línea de caché: halo_start() avanza "listo" cuando el arreglo
+// propio ya se puede leer, y halo_finish() espera el "listo" del vecino,
+// copia los bordes directamente de su arreglo, avanza "leído" y espera el
+// "leído" del vecino antes de volver, porque el sweep fusionado sobrescribe
+// el mismo arreglo apenas termina el intercambio.  Los arreglos fuera de la
+// ventana (gradiente conjugado, celdas fantasma profundas) y los vecinos de
+// otro nodo usan mensajes.
+enum { HALO_PERSISTENT, HALO_NEIGHBOR, HALO_P2P, HALO_SHM };
+
+static const char* halo_names[] = { "persistent", "neighbor", "p2p", "shm" };
+
+// Doubles de la cabecera de cada segmento de la ventana: los contadores
+// "listo" y "leído", cada uno en su línea de caché
+#define HALO_HEADER 16
+#define HALO_READY  0
+#define HALO_READ   8
+
+#define HALO_SLOTS 8
+
+// Pedidos persistentes de un arreglo v con su primer punto propio en v[off]
+typedef struct {
+    double* v;
+    int off, width;
+    MPI_Request req[4];
+} halo_slot_t;
+
+typedef struct {
+    MPI_Comm comm;          // topología cartesiana 1D
+    int left, right;        // vecinos, o MPI_PROC_NULL
+    int mode;
+    int local_n;            // puntos propios
+    halo_slot_t slot[HALO_SLOTS];
+    int nslots;
+    // Intercambio en curso
+    MPI_Request own[4];
+    MPI_Request* req;
+    int nreq;
+    double* v;
+    int off, width;
+    int shm_now;            // el intercambio en curso va por memoria compartida
+    double* buf;            // neighbor: 2 bordes a enviar y 2 recibidos
+    int buf_width;
+    // u y utmp: de la ventana en modo shm, si no de malloc
+    double *u, *utmp;
+    // Modo shm
+    MPI_Comm node;          // procesos del mismo nodo
+    MPI_Win win;
+    double* seg;            // segmento propio (cabecera, u, utmp)
+    size_t seglen;
+    double* nbr[2];         // segmento del vecino izquierdo y derecho, o NULL
+    int nbr_n[2];           // sus puntos propios
+    unsigned long count;    // intercambios por la ventana hechos
+} halo_t;
+
+// Contador de intercambios de la cabecera de un segmento
+static unsigned long* halo_epoch(double* seg, int which) {
+    return (unsigned long*) (seg + which);
+}
+
+// Puntos propios del proceso p con el reparto de main
+static int halo_block(int n, int size, int p) {
+    return (n + 1) / size + (p < (n + 1) % size ? 1 : 0);
+}
+
+// Prepara el intercambio y reserva u y utmp (len doubles cada uno, en
+// cero) para el bloque de local_n puntos de los n+1
+static void halo_init(halo_t* hx, int n, int local_n, int len) {
+    int rank, size, periodic = 0;
+    const char* env = getenv("JACOBI_HALO");
+    memset(hx, 0, sizeof(halo_t));
+    hx->local_n = local_n;
+    hx->mode = HALO_PERSISTENT;
+    if (env != NULL) {
+        int m;
+        for (m = 0; m < 4 && strcmp(env, halo_names[m]) != 0; m++)
+            ;
+        if (m < 4) hx->mode = m;
+        else fprintf(stderr, "JACOBI_HALO desconocido '%s'; se usa persistent\n", env);
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Cart_create(MPI_COMM_WORLD, 1, &size, &periodic, 0, &hx->comm);
+    MPI_Cart_shift(hx->comm, 0, 1, &hx->left, &hx->right);
+
+    if (hx->mode != HALO_SHM) {
+        hx->u = calloc(len, sizeof(double));
+        hx->utmp = calloc(len, sizeof(double));
+        return;
+    }
+    // Todos los segmentos con el largo del bloque más grande, así u y utmp
+    // quedan en el mismo lugar de cada uno
+    int maxlen = (n + 1) / size + 1 + 2*NG;
+    MPI_Info info;
+    MPI_Group world_group, node_group;
+    int nbr_world[2] = { hx->left, hx->right }, nbr_node[2];
+    hx->seglen = HALO_HEADER + 2 * (size_t) maxlen;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &hx->node);
+    // Cada segmento en memoria propia del proceso (primer toque local)
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    MPI_Win_allocate_shared(hx->seglen * sizeof(double), sizeof(double), info,
+                            hx->node, &hx->seg, &hx->win);
+    MPI_Info_free(&info);
+    memset(hx->seg, 0, hx->seglen * sizeof(double));
+    hx->u = hx->seg + HALO_HEADER;
+    hx->utmp = hx->u + maxlen;
+    // ¿Los vecinos están en el mismo nodo?  Su rango en node, o MPI_UNDEFINED
+    MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+    MPI_Comm_group(hx->node, &node_group);
+    for (int side = 0; side < 2; side++) {
+        nbr_node[side] = MPI_UNDEFINED;
+        if (nbr_world[side] != MPI_PROC_NULL)
+            MPI_Group_translate_ranks(world_group, 1, &nbr_world[side], node_group,
+                                      &nbr_node[side]);
+    }
+    MPI_Group_free(&world_group);
+    MPI_Group_free(&node_group);
+    for (int side = 0; side < 2; side++) {
+        if (nbr_node[side] != MPI_UNDEFINED) {
+            MPI_Aint bytes;
+            int disp;
+            MPI_Win_shared_query(hx->win, nbr_node[side], &bytes, &disp, &hx->nbr[side]);
+            hx->nbr_n[side] = halo_block(n, size, nbr_world[side]);
+        }
+    }
+    // Época pasiva para todo el programa: MPI_Win_sync ordena la memoria
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, hx->win);
+    // Los segmentos ya están en cero cuando alguien empieza a leerlos
+    MPI_Barrier(hx->node);
+}
+
+static void halo_free(halo_t* hx) {
+    for (int i = 0; i < hx->nslots; i++)
+        for (int r = 0; r < 4; r++)
+            MPI_Request_free(&hx->slot[i].req[r]);
+    free(hx->buf);
+    if (hx->mode == HALO_SHM) {
+        // Nadie libera su segmento mientras un vecino todavía lo lee
+        MPI_Win_unlock_all(hx->win);
+        MPI_Barrier(hx->node);
+        MPI_Win_free(&hx->win);
+        MPI_Comm_free(&hx->node);
+    } else {
+        free(hx->u);
+        free(hx->utmp);
+    }
+    MPI_Comm_free(&hx->comm);
+}
+
+// Vecino al que se le mandan mensajes de un lado: ninguno si ese lado va
+// por memoria compartida
+static int halo_peer(halo_t* hx, int side, int shm) {
+    if (shm && hx->nbr[side] != NULL) return MPI_PROC_NULL;
+    return side == 0 ? hx->left : hx->right;
+}
+
+// Los cuatro mensajes de un intercambio: hacia la izquierda con tag 0,
+// hacia la derecha con tag 1 (con MPI_PROC_NULL no se mueve nada)
+static void halo_p2p(halo_t* hx, double* v, int off, int width, int shm,
+                     MPI_Request req[4]) {
+    int n = hx->local_n, lp = halo_peer(hx, 0, shm), rp = halo_peer(hx, 1, shm);
+    MPI_Isend(&v[off], width, MPI_DOUBLE, lp, 0, hx->comm, &req[0]);
+    MPI_Irecv(&v[off - width], width, MPI_DOUBLE, lp, 1, hx->comm, &req[1]);
+    MPI_Isend(&v[off + n - width], width, MPI_DOUBLE, rp, 1, hx->comm, &req[2]);
+    MPI_Irecv(&v[off + n], width, MPI_DOUBLE, rp, 0, hx->comm, &req[3]);
+}
+
+// Pedidos persistentes de (v, off, width), creados si todavía no existen;
+// NULL si ya no hay lugar.  Un arreglo está o no en la ventana para
+// siempre, así que los lados que van por memoria compartida también
+static halo_slot_t* halo_slot(halo_t* hx, double* v, int off, int width, int shm) {
+    int i, n = hx->local_n, lp = halo_peer(hx, 0, shm), rp = halo_peer(hx, 1, shm);
+    for (i = 0; i < hx->nslots; i++)
+        if (hx->slot[i].v == v && hx->slot[i].off == off && hx->slot[i].width == width)
+            return &hx->slot[i];
+    if (hx->nslots == HALO_SLOTS) return NULL;
+    halo_slot_t* sl = &hx->slot[hx->nslots++];
+    sl->v = v;
+    sl->off = off;
+    sl->width = width;
+    MPI_Send_init(&v[off], width, MPI_DOUBLE, lp, 0, hx->comm, &sl->req[0]);
+    MPI_Recv_init(&v[off - width], width, MPI_DOUBLE, lp, 1, hx->comm, &sl->req[1]);
+    MPI_Send_init(&v[off + n - width], width, MPI_DOUBLE, rp, 1, hx->comm, &sl->req[2]);
+    MPI_Recv_init(&v[off + n], width, MPI_DOUBLE, rp, 0, hx->comm, &sl->req[3]);
+    return sl;
+}
+
+// Espera a que el contador which del segmento seg llegue a count
+static void halo_wait_epoch(double* seg, int which, unsigned long count) {
+    int spins = 0;
+    while (__atomic_load_n(halo_epoch(seg, which), __ATOMIC_ACQUIRE) < count)
+        if (++spins > 1000) sched_yield();
+}
+
+// Inicia el intercambio de las width celdas de cada borde de v
+static void halo_start(halo_t* hx, double* v, int off, int width) {
+    int n = hx->local_n;
+    hx->v = v;
+    hx->off = off;
+    hx->width = width;
+    hx->shm_now = hx->mode == HALO_SHM && v >= hx->seg && v < hx->seg + hx->seglen;
+    if (hx->shm_now) {
+        // v ya está listo: que los vecinos del nodo lo puedan leer
+        MPI_Win_sync(hx->win);
+        __atomic_store_n(halo_epoch(hx->seg, HALO_READY), ++hx->count, __ATOMIC_RELEASE);
+    }
+    if (hx->mode == HALO_NEIGHBOR) {
+        if (width > hx->buf_width) {
+            free(hx->buf);
+            hx->buf = malloc(4 * width * sizeof(double));
+            hx->buf_width = width;
+        }
+        // Bloque 0 para el vecino de la izquierda, bloque 1 para el de la derecha
+        memcpy(hx->buf, &v[off], width * sizeof(double));
+        memcpy(hx->buf + width, &v[off + n - width], width * sizeof(double));
+        MPI_Ineighbor_alltoall(hx->buf, width, MPI_DOUBLE, hx->buf + 2*width, width,
+                               MPI_DOUBLE, hx->comm, &hx->own[0]);
+        hx->req = hx->own;
+        hx->nreq = 1;
+        return;
+    }
+    halo_slot_t* sl = (hx->mode == HALO_PERSISTENT || hx->mode == HALO_SHM)
+                      ? halo_slot(hx, v, off, width, hx->shm_now) : NULL;
+    if (sl != NULL) {
+        MPI_Startall(4, sl->req);
+        hx->req = sl->req;
+    } else {
+        halo_p2p(hx, v, off, width, hx->shm_now, hx->own);
+        hx->req = hx->own;
+    }
+    hx->nreq = 4;
+}
+
+// Espera el intercambio en curso
+static void halo_finish(halo_t* hx) {
+    MPI_Waitall(hx->nreq, hx->req, MPI_STATUSES_IGNORE);
+    if (hx->mode == HALO_NEIGHBOR) {
+        int w = hx->width, n = hx->local_n;
+        if (hx->left != MPI_PROC_NULL)
+            memcpy(&hx->v[hx->off - w], hx->buf + 2*w, w * sizeof(double));
+        if (hx->right != MPI_PROC_NULL)
+            memcpy(&hx->v[hx->off + n], hx->buf + 3*w, w * sizeof(double));
+    }
+    if (hx->shm_now) {
+        // El mismo arreglo en el segmento de cada vecino del nodo
+        int w = hx->width, n = hx->local_n, off = hx->off;
+        ptrdiff_t pos = hx->v - hx->seg;
+        if (hx->nbr[0] != NULL) {
+            halo_wait_epoch(hx->nbr[0], HALO_READY, hx->count);
+            MPI_Win_sync(hx->win);
+            memcpy(&hx->v[off - w], hx->nbr[0] + pos + off + hx->nbr_n[0] - w,
+                   w * sizeof(double));
+        }
+        if (hx->nbr[1] != NULL) {
+            halo_wait_epoch(hx->nbr[1], HALO_READY, hx->count);
+            MPI_Win_sync(hx->win);
+            memcpy(&hx->v[off + n], hx->nbr[1] + pos + off, w * sizeof(double));
+        }
+        // Nadie escribe su arreglo hasta que los vecinos terminaron de leerlo
+        __atomic_store_n(halo_epoch(hx->seg, HALO_READ), hx->count, __ATOMIC_RELEASE);
+        for (int side = 0; side < 2; side++)
+            if (hx->nbr[side] != NULL)
+                halo_wait_epoch(hx->nbr[side], HALO_READ, hx->count);
+    }
+}
+
+// Intercambia las width celdas de cada borde de v (bloque propio desde
+// v[NG]) y espera a que lleguen
+static void exchange_ghosts(halo_t* hx, double* v, int width) {
+    halo_start(hx, v, NG, width);
+    halo_finish(hx);
+}
+
+// ---------------------------------------------------------------------
+// Medios barridos de Jacobi y Chebyshev con intercambio de celdas
+// fantasma antes de cada uno.  JACOBI_COMM elige cómo se combina con el
+// cálculo:
+//    wait      intercambiar, esperar y después barrer todo el bloque
+//    overlap   (por defecto) el hilo 0 publica los mensajes, todos barren
+//              el interior [lo+1, hi-1), que no lee celdas fantasma, y el
+//              hilo 0 espera y calcula los dos puntos de los extremos
+//    thread    igual, pero el hilo 0 es un hilo de comunicación: espera
+//              enseguida (haciendo avanzar los mensajes dentro de MPI) y
+//              calcula los extremos mientras los demás reparten el interior
+// En todos los casos las llamadas a MPI las hace solo el hilo 0
+// (MPI_THREAD_FUNNELED).
+enum { COMM_WAIT, COMM_OVERLAP, COMM_THREAD };
+
+static const char* comm_names[] = { "wait", "overlap", "thread" };
+
+static int comm_mode(void) {
+    const char* env = getenv("JACOBI_COMM");
+    if (env == NULL) return COMM_OVERLAP;
+    for (int m = 0; m < 3; m++)
+        if (strcmp(env, comm_names[m]) == 0) return m;
+    fprintf(stderr, "JACOBI_COMM desconocido '%s'; se usa overlap\n", env);
+    return COMM_OVERLAP;
+}
+
+// Qué medio barrido se hace: Jacobi, o Chebyshev con peso w
+typedef struct {
+    jacobi_sweep_t half_sweep;
+    jacobi_sweep_res_t sweep_res;
+    int chebyshev;
+    double w;
+} sweep_kind_t;
+
+// dst <- src en [lo, hi); norms (puede ser NULL) acumula el residuo de src
+static void sweep_range(const sweep_kind_t* k, double* dst, const double* src,
+                        const double* f, double h2, int lo, int hi, double* norms) {
+    if (lo >= hi) return;
+    if (k->chebyshev)
+        jacobi_chebyshev_sweep(dst, src, f, h2, k->w, lo, hi, norms);
+    else if (norms)
+        k->sweep_res(dst, src, f, h2, lo, hi, norms);
+    else
+        k->half_sweep(dst, src, f, h2, lo, hi);
+}
+
+// Un medio barrido dst <- src sobre [lo, hi) con celdas fantasma de src
+// frescas, según comm; deja en norms (puede ser NULL) el residuo local de src
+static void halo_sweep(const sweep_kind_t* k, double* dst, double* src,
+                       const double* f, double h2, halo_t* hx, int lo, int hi,
+                       int comm, double* norms) {
+    int ilo = (lo + 1 < hi) ? lo + 1 : hi;
+    int ihi = (hi - 1 > ilo) ? hi - 1 : ilo;
+    double sumsq = 0, linf = 0;
+
+    if (comm == COMM_WAIT)
+        exchange_ghosts(hx, src, 1);
+    #pragma omp parallel reduction(+:sumsq) reduction(max:linf)
+    {
+        int tid = omp_get_thread_num(), nth = omp_get_num_threads();
+        int tlo, thi;
+        double part[2] = { 0, 0 };
+        double* pn = norms ? part : NULL;
+
+        if (comm == COMM_WAIT) {
+            thread_range(lo, hi, &tlo, &thi);
+            sweep_range(k, dst, src, f, h2, tlo, thi, pn);
+        } else {
+            if (tid == 0)
+                halo_start(hx, src, NG, 1);
+            // El interior, sin el hilo 0 si es el de comunicación
+            if (comm == COMM_THREAD && nth > 1) {
+                tlo = ilo + (int) ((long) (ihi - ilo) * (tid - 1) / (nth - 1));
+                thi = ilo + (int) ((long) (ihi - ilo) * tid / (nth - 1));
+                if (tid > 0)
+                    sweep_range(k, dst, src, f, h2, tlo, thi, pn);
+            } else {
+                thread_range(ilo, ihi, &tlo, &thi);
+                sweep_range(k, dst, src, f, h2, tlo, thi, pn);
+            }
+            if (tid == 0) {
+                halo_finish(hx);
+                sweep_range(k, dst, src, f, h2, lo, ilo, pn);
+                sweep_range(k, dst, src, f, h2, ihi, hi, pn);
+            }
+        }
+        sumsq = part[0];
+        linf  = part[1];
+    }
+    if (norms) {
+        norms[0] = sumsq;
+        norms[1] = linf;
+    }
+}
+
+// ---------------------------------------------------------------------
+// Celdas fantasma profundas (JACOBI_GHOST=k, solo --solver jacobi): cada k
+// sweeps se intercambian k valores de cada borde, en un solo mensaje por
+// vecino, y después se hacen k sweeps locales.  El sweep j del grupo
+// recalcula además, de forma redundante, los k-1-j puntos de cada lado que
+// todavía se pueden calcular con los valores recibidos, así al terminar el
+// grupo el bloque propio quedó exacto.  Son dos mensajes por vecino cada k
+// sweeps en vez de cada sweep, a cambio de k(k-1) puntos de más por grupo.
+
+// Lee JACOBI_GHOST: 0 (sin celdas profundas), k >= 1, o -1 para "auto"
+static int ghost_env(void) {
+    const char* env = getenv("JACOBI_GHOST");
+    if (env == NULL) return 0;
+    if (strcmp(env, "auto") == 0) return -1;
+    return atoi(env) > 0 ? atoi(env) : 0;
+}
+
+// --
+// Modelo para JACOBI_GHOST=auto.  Con alpha el costo de un intercambio
+// (latencia) y c el de actualizar un punto, un sweep cuesta en promedio
+// alpha/k + c (local_n + k - 1); el ancho de banda suma lo mismo con
+// cualquier k (un valor por sweep y vecino).  El mínimo está en
+// k = sqrt(alpha / c).  Los dos se miden al arrancar sobre los arreglos
+// reales (los intercambios solo copian los valores iniciales) y se toma el
+// peor de todos los procesos, así todos eligen el mismo k.  k no puede
+// pasar del bloque más chico, que es el que aporta las celdas.
+static int ghost_model(int n, double* u_local, const double* f_local, double h2,
+                       halo_t* hx, int local_n, int lo, int hi, int size,
+                       jacobi_sweep_t half_sweep, double model[2]) {
+    const int reps = 20;
+    double *tmp = calloc(local_n + 2*NG, sizeof(double));
+    double t0;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t0 = MPI_Wtime();
+    for (int r = 0; r < reps; r++)
+        exchange_ghosts(hx, u_local, 1);
+    model[0] = (MPI_Wtime() - t0) / reps;
+    t0 = MPI_Wtime();
+    for (int r = 0; r < reps; r++) {
+        #pragma omp parallel
+        {
+            int tlo, thi;
+            thread_range(lo, hi, &tlo, &thi);
+            half_sweep(tmp, u_local, f_local, h2, tlo, thi);
+        }
+    }
+    model[1] = (MPI_Wtime() - t0) / reps / (hi > lo ? hi - lo : 1);
+    free(tmp);
+    MPI_Allreduce(MPI_IN_PLACE, model, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+    int k = (int) (sqrt(model[0] / model[1]) + 0.5);
+    int kmax = (n + 1) / size;
+    return (k < 1) ? 1 : (k > kmax ? kmax : k);
+}
+
+// 2*nsteps sweeps de Jacobi con celdas fantasma de ancho k sobre copias de
+// u_local y f_local; deja el resultado en u_local y devuelve los sweeps
+// hechos.  Los chequeos del residuo son los del ciclo normal: el primer
+// sweep del par mide el residuo de los puntos propios y la decisión se
+// toma al terminar el par, con un Allreduce
+static int deep_jacobi(int n, int nsteps, int k, double* u_local, int local_n,
+                       int local_start, int rank, int size, halo_t* hx,
+                       jacobi_sweep_t half_sweep, jacobi_sweep_res_t sweep_res,
+                       const jacobi_opts_t* opts, jacobi_stats_t* stats,
+                       MPI_Datatype norms_type, MPI_Op norms_reduce) {
+    double h = 1.0 / n, h2 = h * h;
+    int len = local_n + 2*k, sweep = 0, nsweeps = 2*nsteps, done = 0;
+    // Índice e <-> punto global local_start - k + e
+    double *src = calloc(len, sizeof(double));
+    double *dst = calloc(len, sizeof(double));
+    double *f   = malloc(len * sizeof(double));
+    double norms[2] = { 0, 0 };
+    // Puntos propios que se actualizan (sin las fronteras globales)
+    int olo = (rank == 0) ? k + 1 : k;
+    int ohi = (rank == size - 1) ? k + local_n - 1 : k + local_n;
+
+    memcpy(src + k, u_local + NG, local_n * sizeof(double));
+    memcpy(dst + k, u_local + NG, local_n * sizeof(double));
+    for (int e = 0; e < len; e++)
+        f[e] = (local_start - k + e) * h;
+
+    while (sweep < nsweeps && !done) {
+        int g = (nsweeps - sweep < k) ? nsweeps - sweep : k;
+        // Siempre se mandan los k valores (el bloque más chico tiene al
+        // menos k), aunque el último grupo solo use g
+        halo_start(hx, src, k, k);
+        halo_finish(hx);
+        for (int j = 0; j < g && !done; j++) {
+            // Con g valores recibidos, el sweep j es exacto en [lo, hi)
+            int lo = (rank == 0) ? olo : k - g + 1 + j;
+            int hi = (rank == size - 1) ? ohi : k + local_n + g - 1 - j;
+            int check = sweep % 2 == 0 && jacobi_check_due(opts, sweep);
+            double sumsq = 0, linf = 0;
+            #pragma omp parallel reduction(+:sumsq) reduction(max:linf)
+            {
+                int tlo, thi;
+                double part[2] = { 0, 0 };
+                thread_range(lo, hi, &tlo, &thi);
+                if (check) {
+                    // Residuo solo de los puntos propios, los demás se repiten
+                    int a = (tlo > olo) ? tlo : olo, b = (thi < ohi) ? thi : ohi;
+                    if (a < b) {
+                        half_sweep(dst, src, f, h2, tlo, a);
+                        sweep_res(dst, src, f, h2, a, b, part);
+                        half_sweep(dst, src, f, h2, b, thi);
+                    } else {
+                        half_sweep(dst, src, f, h2, tlo, thi);
+                    }
+                } else {
+                    half_sweep(dst, src, f, h2, tlo, thi);
+                }
+                sumsq = part[0];
+                linf  = part[1];
+            }
+            if (check) {
+                norms[0] = sumsq;
+                norms[1] = linf;
+            }
+            double* t = src; src = dst; dst = t;
+            sweep++;
+            if (sweep % 2 == 0 && jacobi_check_due(opts, sweep - 2)) {
+                MPI_Allreduce(MPI_IN_PLACE, norms, 1, norms_type, norms_reduce, MPI_COMM_WORLD);
+                done = jacobi_converged(opts, stats, sweep - 2, norms, h);
+            }
+        }
+    }
+    memcpy(u_local + NG, src + k, local_n * sizeof(double));
+    free(src);
+    free(dst);
+    free(f);
+    return sweep;
+}
+
+// Combina dos pares { suma de r^2, max |r| }: así la suma y el máximo del
+// residuo viajan en un solo MPI_Allreduce
+static void norms_op(void* in, void* inout, int* len, MPI_Datatype* type) {
+    double* a = in;
+    double* b = inout;
+    (void) type;
+    for (int i = 0; i < *len; i++, a += 2, b += 2) {
+        b[0] += a[0];
+        if (a[1] > b[1]) b[1] = a[1];
+    }
+}
+
+// ---------------------------------------------------------------------
+// Multigrid distribuido (--solver vcycle / fmg) con las operaciones de
+// multigrid.c.  Cada nivel se reparte igual que el fino: el punto grueso I
+// vive en el proceso dueño del punto fino 2I, así restricción y
+// prolongación solo necesitan una celda fantasma del vecino.  Se agregan
+// niveles mientras n_l sea par y todos los procesos tengan al menos dos
+// puntos; el nivel más grueso se junta en el proceso 0, que lo resuelve
+// exacto con mg_direct y devuelve cada bloque.
+
+typedef struct {
+    int nlevels;
     int rank, size;
+    int n[MG_MAX_LEVELS];     // intervalos del nivel
+    int gs[MG_MAX_LEVELS];    // primer punto global propio
+    int m[MG_MAX_LEVELS];     // cantidad de puntos propios
+    // m+2 valores: índice local 1..m, celdas fantasma en 0 y m+1
+    double *u[MG_MAX_LEVELS], *f[MG_MAX_LEVELS], *r[MG_MAX_LEVELS];
+    int *counts, *displs;     // bloques del nivel más grueso por proceso
+    double *U, *F, *work;     // nivel más grueso completo (solo proceso 0)
+} mg_mpi_t;
+
+// Bloque [gs, ge) de puntos globales del proceso p en el nivel l
+static void mg_block(int n, int size, int p, int l, int* gs, int* ge) {
+    int q = (n + 1) / size, rem = (n + 1) % size;
+    *gs = p * q + (p < rem ? p : rem);
+    *ge = *gs + q + (p < rem ? 1 : 0);
+    for (int k = 0; k < l; k++) {
+        *gs = (*gs + 1) / 2;
+        *ge = (*ge + 1) / 2;
+    }
+}
+
+// u0 y f0 apuntan a la celda fantasma izquierda del nivel fino
+static void mg_mpi_setup(mg_mpi_t* mg, int n, double* u0, double* f0,
+                         int rank, int size) {
+    int l, p, gs, ge, nl = n;
+    mg->rank = rank;
+    mg->size = size;
+    for (l = 0; l < MG_MAX_LEVELS; l++) {
+        if (l > 0) {
+            // ¿Se puede agregar el nivel l? (todos calculan lo mismo)
+            int ok = nl % 2 == 0 && nl / 2 >= 2;
+            for (p = 0; p < size && ok; p++) {
+                mg_block(n, size, p, l, &gs, &ge);
+                ok = ge - gs >= 2;
+            }
+            if (!ok) break;
+            nl /= 2;
+        }
+        mg_block(n, size, rank, l, &gs, &ge);
+        mg->n[l]  = nl;
+        mg->gs[l] = gs;
+        mg->m[l]  = ge - gs;
+        mg->u[l]  = (l == 0) ? u0 : calloc(mg->m[l] + 2, sizeof(double));
+        mg->f[l]  = (l == 0) ? f0 : calloc(mg->m[l] + 2, sizeof(double));
+        mg->r[l]  = calloc(mg->m[l] + 2, sizeof(double));
+    }
+    mg->nlevels = l;
+
+    // Reparto del nivel más grueso para Gatherv/Scatterv
+    mg->counts = malloc(size * sizeof(int));
+    mg->displs = malloc(size * sizeof(int));
+    for (p = 0; p < size; p++) {
+        mg_block(n, size, p, l - 1, &gs, &ge);
+        mg->counts[p] = ge - gs;
+        mg->displs[p] = gs;
+    }
+    mg->U = mg->F = mg->work = NULL;
+    if (rank == 0) {
+        mg->U    = malloc((nl + 1) * sizeof(double));
+        mg->F    = malloc((nl + 1) * sizeof(double));
+        mg->work = malloc((nl + 1) * sizeof(double));
+    }
+}
+
+static void mg_mpi_free(mg_mpi_t* mg) {
+    for (int l = 0; l < mg->nlevels; l++) {
+        if (l > 0) {
+            free(mg->u[l]);
+            free(mg->f[l]);
+        }
+        free(mg->r[l]);
+    }
+    free(mg->counts);
+    free(mg->displs);
+    free(mg->U);
+    free(mg->F);
+    free(mg->work);
+}
+
+// Intercambiar una celda fantasma con cada vecino
+static void mg_exchange(mg_mpi_t* mg, double* a, int l) {
+    MPI_Request requests[4];
+    int req_count = 0, m = mg->m[l];
+    if (mg->rank > 0) {
+        MPI_Isend(&a[1], 1, MPI_DOUBLE, mg->rank - 1, 3, MPI_COMM_WORLD, &requests[req_count++]);
+        MPI_Irecv(&a[0], 1, MPI_DOUBLE, mg->rank - 1, 4, MPI_COMM_WORLD, &requests[req_count++]);
+    }
+    if (mg->rank < mg->size - 1) {
+        MPI_Isend(&a[m], 1, MPI_DOUBLE, mg->rank + 1, 4, MPI_COMM_WORLD, &requests[req_count++]);
+        MPI_Irecv(&a[m + 1], 1, MPI_DOUBLE, mg->rank + 1, 3, MPI_COMM_WORLD, &requests[req_count++]);
+    }
+    MPI_Waitall(req_count, requests, MPI_STATUSES_IGNORE);
+}
+
+// Rango local [lo, hi) de puntos interiores del nivel l (sin fronteras globales)
+static void mg_range(mg_mpi_t* mg, int l, int* lo, int* hi) {
+    *lo = (mg->rank == 0) ? 2 : 1;
+    *hi = (mg->rank == mg->size - 1) ? mg->m[l] : mg->m[l] + 1;
+}
+
+// Desplazamiento entre el índice grueso local K y el fino local 2K + off
+static int mg_off(mg_mpi_t* mg, int l) {
+    return 2 * mg->gs[l + 1] - mg->gs[l] - 1;
+}
+
+static double mg_h2(mg_mpi_t* mg, int l) {
+    return 1.0 / ((double) mg->n[l] * mg->n[l]);
+}
+
+// nsweeps barridos de Jacobi amortiguado, de a dos a través de r
+static void mg_mpi_relax(mg_mpi_t* mg, int l, int nsweeps) {
+    int lo, hi, m = mg->m[l];
+    double *u = mg->u[l], *r = mg->r[l];
+    mg_range(mg, l, &lo, &hi);
+    if (mg->rank == 0) r[1] = u[1];
+    if (mg->rank == mg->size - 1) r[m] = u[m];
+    for (int sweep = 0; sweep < nsweeps; sweep += 2) {
+        mg_exchange(mg, u, l);
+        mg_smooth(r, u, mg->f[l], mg_h2(mg, l), lo, hi);
+        mg_exchange(mg, r, l);
+        mg_smooth(u, r, mg->f[l], mg_h2(mg, l), lo, hi);
+    }
+}
+
+// r = f + u'' en los puntos propios (cero en las fronteras globales)
+static void mg_mpi_residual(mg_mpi_t* mg, int l, double norms[2]) {
+    int lo, hi, m = mg->m[l];
+    mg_range(mg, l, &lo, &hi);
+    mg_exchange(mg, mg->u[l], l);
+    if (mg->rank == 0) mg->r[l][1] = 0;
+    if (mg->rank == mg->size - 1) mg->r[l][m] = 0;
+    mg_residual(mg->r[l], mg->u[l], mg->f[l], mg_h2(mg, l), lo, hi, norms);
+}
+
+// Ponderación completa de a (nivel l) en c (nivel l+1)
+static void mg_mpi_restrict(mg_mpi_t* mg, int l, double* c, double* a) {
+    int lo, hi;
+    mg_range(mg, l + 1, &lo, &hi);
+    mg_exchange(mg, a, l);
+    mg_restrict(c, a, lo, hi, mg_off(mg, l));
+}
+
+// Sumar al nivel l la interpolación de u del nivel l+1
+static void mg_mpi_prolong(mg_mpi_t* mg, int l) {
+    int lo, hi;
+    mg_range(mg, l, &lo, &hi);
+    mg_exchange(mg, mg->u[l + 1], l + 1);
+    mg_prolong(mg->u[l], mg->u[l + 1], lo, hi, mg_off(mg, l));
+}
+
+// Resolver exacto el nivel más grueso en el proceso 0
+static void mg_mpi_coarse(mg_mpi_t* mg, int l) {
+    int m = mg->m[l];
+    MPI_Gatherv(mg->u[l] + 1, m, MPI_DOUBLE, mg->U, mg->counts, mg->displs,
+                MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(mg->f[l] + 1, m, MPI_DOUBLE, mg->F, mg->counts, mg->displs,
+                MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (mg->rank == 0)
+        mg_direct(mg->n[l], mg->U, mg->F, mg->work);
+    MPI_Scatterv(mg->U, mg->counts, mg->displs, MPI_DOUBLE, mg->u[l] + 1, m,
+                 MPI_DOUBLE, 0, MPI_COMM_WORLD);
+}
+
+static void mg_mpi_vcycle(mg_mpi_t* mg, int l) {
+    if (l == mg->nlevels - 1) {
+        mg_mpi_coarse(mg, l);
+        return;
+    }
+    mg_mpi_relax(mg, l, MG_PRE_SWEEPS);
+    // Ecuación del error en el nivel grueso, con e = 0 en la frontera
+    mg_mpi_residual(mg, l, NULL);
+    mg_mpi_restrict(mg, l, mg->f[l + 1], mg->r[l]);
+    memset(mg->u[l + 1], 0, (mg->m[l + 1] + 2) * sizeof(double));
+    mg_mpi_vcycle(mg, l + 1);
+    mg_mpi_prolong(mg, l);
+    mg_mpi_relax(mg, l, MG_POST_SWEEPS);
+}
+
+// Multigrid completo: f y los valores de frontera a todos los niveles,
+// solución exacta en el más grueso y un ciclo V en cada nivel al subir
+static void mg_mpi_fmg(mg_mpi_t* mg) {
+    int l, lo, hi;
+    for (l = 0; l < mg->nlevels - 1; l++) {
+        mg_mpi_restrict(mg, l, mg->f[l + 1], mg->f[l]);
+        if (mg->rank == 0) mg->u[l + 1][1] = mg->u[l][1];
+        if (mg->rank == mg->size - 1) mg->u[l + 1][mg->m[l + 1]] = mg->u[l][mg->m[l]];
+    }
+    mg_mpi_coarse(mg, l);
+    for (l = mg->nlevels - 2; l >= 0; l--) {
+        mg_range(mg, l, &lo, &hi);
+        memset(mg->u[l] + lo, 0, (hi - lo) * sizeof(double));
+        mg_mpi_prolong(mg, l);
+        mg_mpi_vcycle(mg, l);
+    }
+}
+
+// Igual que mg_solve(): devuelve la cantidad de ciclos hechos
+static int mg_mpi_solve(mg_mpi_t* mg, int fmg, int maxcycles,
+                        const jacobi_opts_t* opts, jacobi_stats_t* stats,
+                        MPI_Datatype norms_type, MPI_Op norms_reduce) {
+    int cycles = 0, done = 0;
+    if (fmg && maxcycles > 0) {
+        mg_mpi_fmg(mg);
+        cycles = 1;
+    }
+    for (;;) {
+        if (opts->check > 0) {
+            double norms[2] = { 0, 0 };
+            mg_mpi_residual(mg, 0, norms);
+            MPI_Allreduce(MPI_IN_PLACE, norms, 1, norms_type, norms_reduce, MPI_COMM_WORLD);
+            done = jacobi_converged(opts, stats, cycles, norms, 1.0 / mg->n[0]);
+        }
+        if (done || cycles >= maxcycles) break;
+        mg_mpi_vcycle(mg, 0);
+        cycles++;
+    }
+    stats->sweeps = cycles;
+    return cycles;
+}
+
+// ---------------------------------------------------------------------
+// Solución directa distribuida (--solver direct y referencia de --error):
+// Thomas particionado con un separador en el último punto de cada proceso
+// menos el último.  Cada proceso resuelve su bloque con extremos en cero,
+// un MPI_Allgather junta los extremos de todos los bloques y cada proceso
+// resuelve por su cuenta el sistema de los size-1 separadores, así no hace
+// falta otro mensaje para repartirlos.  v y f en índices locales: [lo, hi)
+// son los puntos libres del bloque y v[hi] el separador propio (u[n] en el
+// último proceso).  work tiene espacio para v.
+static void direct_mpi(int n, double* v, const double* f, double h2, int lo, int hi,
+                       double* work, int rank, int size) {
+    double mine[5];
+    double *all  = malloc((11*size + 2) * sizeof(double));
+    double *y    = all + 5*size;
+    double *fsep = y + 2*size;
+    double *x    = fsep + size + 1;
+    int *sep = malloc((size + 1) * sizeof(int));
+
+    // Fase 1: bloque propio con extremos en cero
+    tridiag_block(v, f, h2, lo, hi, work);
+    mine[0] = v[lo - 1];    // u[0] en el proceso 0
+    mine[1] = v[lo];
+    mine[2] = v[hi - 1];
+    mine[3] = f[hi];
+    mine[4] = v[hi];        // u[n] en el último proceso
+    MPI_Allgather(mine, 5, MPI_DOUBLE, all, 5, MPI_DOUBLE, MPI_COMM_WORLD);
+
+    // Fase 2: separadores, con el mismo reparto de puntos que main
+    int start = 0;
+    sep[0] = 0;
+    for (int p = 0; p < size; p++) {
+        start += (n + 1) / size + (p < (n + 1) % size ? 1 : 0);
+        sep[p + 1] = start - 1;
+        y[2*p]     = all[5*p + 1];
+        y[2*p + 1] = all[5*p + 2];
+        fsep[p + 1] = all[5*p + 3];
+    }
+    x[0]    = all[0];
+    x[size] = all[5*(size - 1) + 4];
+    tridiag_interface(size, sep, y, fsep, h2, x, work);
+
+    // Fase 3: recta entre los dos separadores del bloque
+    v[hi] = x[rank + 1];
+    tridiag_correct(v, lo, hi, x[rank], x[rank + 1]);
+
+    free(sep);
+    free(all);
+}
+
+// ---------------------------------------------------------------------
+// Gradiente conjugado distribuido (--solver cg / pcg) con los kernels de
+// jacobi_kernels.c: por iteración una pasada de actualización, un
+// intercambio de una celda fantasma de z y la pasada del estencil, que
+// deja los dos productos internos y el residuo en dots[4] = { suma r^2,
+// max |r|, (r, z), (w, z) }; esos cuatro valores viajan en un solo
+// MPI_Allreduce y todos los procesos calculan los mismos alpha y beta.
+// v y f en índices locales, [lo, hi) los puntos libres del bloque.
+// Devuelve las iteraciones hechas
+
+// Suma, máximo, suma, suma: la reducción de dots[]
+static void cg_op(void* in, void* inout, int* len, MPI_Datatype* type) {
+    double* a = in;
+    double* b = inout;
+    (void) type;
+    for (int i = 0; i < *len; i++, a += 4, b += 4) {
+        b[0] += a[0];
+        if (a[1] > b[1]) b[1] = a[1];
+        b[2] += a[2];
+        b[3] += a[3];
+    }
+}
+
+static int cg_mpi(int n, int niters, double* v, const double* f, int local_n,
+                  int lo, int hi, halo_t* hx,
+                  const jacobi_opts_t* opts, jacobi_stats_t* stats) {
+    double h = 1.0 / n, h2 = h * h;
+    double dinv = (opts->solver == JACOBI_SOLVER_PCG) ? 0.5 : 1.0;
+    double gamma = 0, alpha = 0, beta = 0;
+    int len = local_n + 2*NG, it, done = 0;
+    // z, p y s valen cero en las fronteras globales y en las celdas
+    // fantasma que no tienen vecino
+    double *r = calloc(len, sizeof(double));
+    double *w = calloc(len, sizeof(double));
+    double *p = calloc(len, sizeof(double));
+    double *s = calloc(len, sizeof(double));
+    double *z = (dinv != 1) ? calloc(len, sizeof(double)) : r;
+
+    MPI_Datatype dots_type;
+    MPI_Op dots_reduce;
+    MPI_Type_contiguous(4, MPI_DOUBLE, &dots_type);
+    MPI_Type_commit(&dots_type);
+    MPI_Op_create(cg_op, 1, &dots_reduce);
+
+    // r = h2 f - A u necesita la celda fantasma de u
+    exchange_ghosts(hx, v, 1);
+    #pragma omp parallel
+    {
+        int tlo, thi;
+        thread_range(lo, hi, &tlo, &thi);
+        jacobi_cg_init(r, z, v, f, h2, dinv, tlo, thi);
+    }
+
+    for (it = 0; ; it++) {
+        double d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+
+        if (it > 0) {
+            #pragma omp parallel
+            {
+                int tlo, thi;
+                thread_range(lo, hi, &tlo, &thi);
+                jacobi_cg_update(v, r, z, p, s, w, alpha, beta, dinv, tlo, thi);
+            }
+        }
+
+        // Un intercambio y un Allreduce por iteración
+        exchange_ghosts(hx, z, 1);
+        #pragma omp parallel reduction(+:d0,d2,d3) reduction(max:d1)
+        {
+            int tlo, thi;
+            double d[4] = { 0, 0, 0, 0 };
+            thread_range(lo, hi, &tlo, &thi);
+            jacobi_cg_apply(w, z, r, h2, tlo, thi, d);
+            d0 = d[0]; d1 = d[1]; d2 = d[2]; d3 = d[3];
+        }
+        double dots[4] = { d0, d1, d2, d3 };
+        MPI_Allreduce(MPI_IN_PLACE, dots, 1, dots_type, dots_reduce, MPI_COMM_WORLD);
+
+        if (it > 0 && jacobi_check_due(opts, it))
+            done = jacobi_converged(opts, stats, it, dots, h);
+        if (done || it == niters) break;
+        jacobi_cg_step(dots, &gamma, &alpha, &beta);
+    }
+
+    MPI_Op_free(&dots_reduce);
+    MPI_Type_free(&dots_type);
+    if (z != r) free(z);
+    free(r); free(w); free(p); free(s);
+    return it;
+}
+
+// ---------------------------------------------------------------------
+// Escritura de la solución.  JACOBI_OUTPUT elige el formato:
+//    binary   (por defecto) cabecera out_header_t y después los n+1
+//             doubles de u en el orden de la máquina
+//    text     "x u" por línea, todas de OUT_RECORD bytes
+//    gather   "%g %g" por línea, todo juntado y escrito por el proceso 0
+// binary y text se escriben con MPI-IO: cada proceso sabe dónde empieza su
+// parte en el archivo y la escribe con una sola MPI_File_write_at_all, sin
+// pasar por el proceso 0.
+enum { OUTPUT_BINARY, OUTPUT_TEXT, OUTPUT_GATHER };
+
+static const char* output_names[] = { "binary", "text", "gather" };
+
+static int output_mode(void) {
+    const char* env = getenv("JACOBI_OUTPUT");
+    if (env == NULL) return OUTPUT_BINARY;
+    for (int m = 0; m < 3; m++)
+        if (strcmp(env, output_names[m]) == 0) return m;
+    fprintf(stderr, "JACOBI_OUTPUT desconocido '%s'; se usa binary\n", env);
+    return OUTPUT_BINARY;
+}
+
+// Cabecera del archivo binario (32 bytes)
+typedef struct {
+    char magic[8];          // "JACOBI1D"
+    int64_t points;         // n + 1
+    double h;               // u[i] es la solución en x = i*h
+    int64_t data;           // byte donde empieza u
+} out_header_t;
+
+// Línea del modo text: x con 10 cifras y u con 17, con signo y exponente
+// de hasta tres dígitos
+#define OUT_RECORD 43
+#define OUT_FORMAT "% -17.9e % -24.16e\n"
+
+// u[0 .. local_n) son los puntos local_start .. local_start + local_n - 1
+static void write_mpiio(const char* fname, int mode, const double* u, int local_n,
+                        int local_start, int n, double h, int rank) {
+    MPI_File fh;
+    MPI_Offset total;
+    int rc = MPI_File_open(MPI_COMM_WORLD, fname, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                           MPI_INFO_NULL, &fh);
+    if (rc != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "No se pudo abrir %s\n", fname);
+        return;
+    }
+    if (mode == OUTPUT_BINARY) {
+        out_header_t hd;
+        memcpy(hd.magic, "JACOBI1D", 8);
+        hd.points = n + 1;
+        hd.h = h;
+        hd.data = sizeof(out_header_t);
+        total = hd.data + (MPI_Offset) (n + 1) * sizeof(double);
+        // Si el archivo ya existía y era más largo, que no quede la cola
+        MPI_File_set_size(fh, total);
+        if (rank == 0)
+            MPI_File_write_at(fh, 0, &hd, sizeof(hd), MPI_BYTE, MPI_STATUS_IGNORE);
+        MPI_File_write_at_all(fh, hd.data + (MPI_Offset) local_start * sizeof(double),
+                              u, local_n, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    } else {
+        // Cada hilo formatea sus líneas; un tipo de OUT_RECORD bytes evita
+        // que la cuenta de la escritura pase de int
+        MPI_Datatype record;
+        char* buf = malloc((size_t) local_n * OUT_RECORD);
+        #pragma omp parallel for
+        for (int i = 0; i < local_n; i++) {
+            char line[OUT_RECORD + 1];
+            snprintf(line, sizeof(line), OUT_FORMAT, (local_start + i) * h, u[i]);
+            memcpy(&buf[(size_t) i * OUT_RECORD], line, OUT_RECORD);
+        }
+        MPI_Type_contiguous(OUT_RECORD, MPI_CHAR, &record);
+        MPI_Type_commit(&record);
+        total = (MPI_Offset) (n + 1) * OUT_RECORD;
+        MPI_File_set_size(fh, total);
+        MPI_File_write_at_all(fh, (MPI_Offset) local_start * OUT_RECORD, buf, local_n,
+                              record, MPI_STATUS_IGNORE);
+        MPI_Type_free(&record);
+        free(buf);
+    }
+    MPI_File_close(&fh);
+}
+
+// Como antes: el proceso 0 junta u en un arreglo global y escribe el texto
+static void write_gather(const char* fname, const double* u, int local_n, int local_start,
+                         int n, double h, int rank, int size) {
+    if (rank != 0) {
+        MPI_Send(u, local_n, MPI_DOUBLE, 0, 2, MPI_COMM_WORLD);
+        return;
+    }
+    double *u_global = malloc((n + 1) * sizeof(double));
+    int remainder = (n + 1) % size;
+    memcpy(&u_global[local_start], u, local_n * sizeof(double));
+    for (int p = 1; p < size; p++) {
+        int p_local_n = (n + 1) / size;
+        if (p < remainder) p_local_n++;
+        int p_start = p * ((n + 1) / size) + (p < remainder ? p : remainder);
+        MPI_Recv(&u_global[p_start], p_local_n, MPI_DOUBLE, p, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+    FILE* fp = fopen(fname, "w");
+    for (int i = 0; i <= n; i++) fprintf(fp, "%g %g\n", i*h, u_global[i]);
+    fclose(fp);
+    free(u_global);
+}
+
+int main(int argc, char** argv) {
+    int rank, size, provided;
     
-    // Inicializar MPI
-    MPI_Init(&argc, &argv);
+    // Inicializar MPI: los hilos OpenMP existen, pero solo el hilo 0 llama a MPI
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (provided < MPI_THREAD_FUNNELED && rank == 0)
+        fprintf(stderr, "Aviso: MPI no garantiza MPI_THREAD_FUNNELED\n");
+    
+    // --tol X, --check K, --solver S y --error se pueden poner en cualquier
+    // lugar y se quitan de argv
+    jacobi_opts_t opts;
+    jacobi_stats_t stats = { 0, 0, 0, 0 };
+    jacobi_parse_opts(&argc, argv, &opts);
+    jacobi_require_solvers(&opts, JACOBI_SOLVER_MASK(JACOBI_SOLVER_JACOBI) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_VCYCLE) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_FMG) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CHEBYSHEV) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_DIRECT) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_CG) |
+                                  JACOBI_SOLVER_MASK(JACOBI_SOLVER_PCG));
     
     int n     = (argc > 1) ? atoi(argv[1]) : 100;
     int nsteps= (argc > 2) ? atoi(argv[2]) : 100;
@@ -22,18 +1068,49 @@ int main(int argc, char** argv) {
 
     double h  = 1.0 / n;
     double h2 = h * h;
+    jacobi_sweep_t half_sweep = jacobi_kernel(n / size);
+    // El kernel fusionado hace dos sweeps con un solo intercambio de dos
+    // celdas, así que no se puede solapar: solo se usa con JACOBI_COMM=wait
+    int comm = comm_mode();
+    int ghost = (opts.solver == JACOBI_SOLVER_JACOBI) ? ghost_env() : 0;
+    jacobi_fused_t fused_sweep = (jacobi_use_fused() && comm == COMM_WAIT && ghost == 0 &&
+                                  opts.solver == JACOBI_SOLVER_JACOBI)
+                                 ? jacobi_fused_kernel() : NULL;
+    jacobi_sweep_res_t sweep_res = jacobi_sweep_res_kernel();
+    jacobi_fused_res_t fused_res = jacobi_fused_res_kernel();
+
+    // Tipo de dos doubles y operación para reducir el residuo
+    MPI_Datatype norms_type;
+    MPI_Op norms_reduce;
+    MPI_Type_contiguous(2, MPI_DOUBLE, &norms_type);
+    MPI_Type_commit(&norms_type);
+    MPI_Op_create(norms_op, 1, &norms_reduce);
 
     // Calcular la distribución de trabajo por proceso MPI
-    int local_n = n / size;
-    int remainder = n % size;
+    // (los n+1 puntos 0..n, incluidas las dos fronteras)
+    int local_n = (n + 1) / size;
+    int remainder = (n + 1) % size;
     int local_start = rank * local_n + (rank < remainder ? rank : remainder);
     if (rank < remainder) local_n++;
     int local_end = local_start + local_n - 1;
 
-    // Reservar memoria local (incluye puntos de frontera para comunicación)
-    double *u_local    = malloc((local_n + 2) * sizeof(double));
-    double *utmp_local = malloc((local_n + 2) * sizeof(double));
-    double *f_local    = malloc((local_n + 2) * sizeof(double));
+    if (local_n < NG) {
+        if (rank == 0) fprintf(stderr, "Se necesitan al menos %d puntos por proceso\n", NG);
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    // Vecinos y pedidos del intercambio de celdas fantasma, una sola vez;
+    // también reserva u_local y utmp_local (en la ventana compartida del
+    // nodo con JACOBI_HALO=shm)
+    halo_t halo;
+    halo_init(&halo, n, local_n, local_n + 2*NG);
+
+    // Reservar memoria local (incluye NG celdas fantasma a cada lado);
+    // el punto global local_start + j está en el índice local NG + j
+    double *u_local    = halo.u;
+    double *utmp_local = halo.utmp;
+    double *f_local    = malloc((local_n + 2*NG) * sizeof(double));
     
     if(!u_local || !utmp_local || !f_local) { 
         fprintf(stderr, "Error en malloc en proceso %d\n", rank); 
@@ -42,103 +1119,171 @@ int main(int argc, char** argv) {
     }
 
     // Inicializar arrays locales
-    memset(u_local, 0, (local_n + 2) * sizeof(double));
-    for(int i = 1; i <= local_n; i++) {
-        int global_i = local_start + i - 1;
+    memset(u_local, 0, (local_n + 2*NG) * sizeof(double));
+    memset(utmp_local, 0, (local_n + 2*NG) * sizeof(double));
+    // f también en las celdas fantasma (el kernel fusionado la usa en lo-1 y hi)
+    for(int i = 0; i < local_n + 2*NG; i++) {
+        int global_i = local_start + i - NG;
         f_local[i] = global_i * h;
-        utmp_local[i] = 0.0;
     }
     
     // Condiciones de frontera globales
     if (rank == 0) {
-        u_local[1] = 0.0;  // u[0] = 0
-        utmp_local[1] = 0.0;
+        u_local[NG] = 0.0;  // u[0] = 0
+        utmp_local[NG] = 0.0;
     }
     if (rank == size - 1) {
-        u_local[local_n] = 0.0;  // u[n] = 0
-        utmp_local[local_n] = 0.0;
+        u_local[NG + local_n - 1] = 0.0;  // u[n] = 0
+        utmp_local[NG + local_n - 1] = 0.0;
     }
 
+    // Rango local que se actualiza: las fronteras globales u[0] y u[n]
+    // (primer punto del rango 0 y último del último rango) no cambian
+    int lo = (rank == 0) ? NG + 1 : NG;
+    int hi = (rank == size - 1) ? NG + local_n - 1 : NG + local_n;
+
+    // Ancho de las celdas fantasma profundas, elegido por el modelo con "auto"
+    double model[2] = { 0, 0 };
+    if (ghost < 0)
+        ghost = ghost_model(n, u_local, f_local, h2, &halo, local_n, lo, hi, size,
+                            half_sweep, model);
+    else if (ghost > (n + 1) / size)
+        ghost = (n + 1) / size;
+
     timing_t tstart, tend;
     if (rank == 0) get_time(&tstart);
 
-    // Iteraciones Jacobi con MPI
-    for(int step = 0; step < nsteps; step++) {
-        // Intercambiar datos de frontera entre procesos vecinos
-        MPI_Request requests[4];
-        int req_count = 0;
-        
-        // Enviar/recibir con proceso anterior
-        if (rank > 0) {
-            MPI_Isend(&u_local[1], 1, MPI_DOUBLE, rank - 1, 0, MPI_COMM_WORLD, &requests[req_count++]);
-            MPI_Irecv(&u_local[0], 1, MPI_DOUBLE, rank - 1, 1, MPI_COMM_WORLD, &requests[req_count++]);
-        }
-        
-        // Enviar/recibir con proceso siguiente
-        if (rank < size - 1) {
-            MPI_Isend(&u_local[local_n], 1, MPI_DOUBLE, rank + 1, 1, MPI_COMM_WORLD, &requests[req_count++]);
-            MPI_Irecv(&u_local[local_n + 1], 1, MPI_DOUBLE, rank + 1, 0, MPI_COMM_WORLD, &requests[req_count++]);
-        }
-        
-        // Esperar comunicaciones
-        MPI_Waitall(req_count, requests, MPI_STATUSES_IGNORE);
-        
-        // Primer sweep - OpenMP sobre puntos internos
-        #pragma omp parallel for schedule(static)
-        for(int i = 1; i <= local_n; i++) {
-            int left = (i == 1 && rank == 0) ? u_local[1] : u_local[i-1];
-            int right = (i == local_n && rank == size - 1) ? u_local[local_n] : u_local[i+1];
-            utmp_local[i] = (left + right + h2 * f_local[i]) * 0.5;
-        }
+    if (opts.solver == JACOBI_SOLVER_VCYCLE || opts.solver == JACOBI_SOLVER_FMG) {
+        // Multigrid: nsteps cuenta ciclos V
+        mg_mpi_t mg;
+        mg_mpi_setup(&mg, n, u_local + NG - 1, f_local + NG - 1, rank, size);
+        mg_mpi_solve(&mg, opts.solver == JACOBI_SOLVER_FMG, nsteps, &opts, &stats,
+                     norms_type, norms_reduce);
+        mg_mpi_free(&mg);
+    } else if (opts.solver == JACOBI_SOLVER_DIRECT) {
+        // Thomas particionado entre procesos, utmp_local como espacio de trabajo
+        direct_mpi(n, u_local, f_local, h2, lo, NG + local_n - 1, utmp_local, rank, size);
+    } else if (opts.solver == JACOBI_SOLVER_CG || opts.solver == JACOBI_SOLVER_PCG) {
+        // nsteps cuenta iteraciones de gradiente conjugado
+        stats.sweeps = cg_mpi(n, nsteps, u_local, f_local, local_n, lo, hi, &halo,
+                              &opts, &stats);
+    } else if (ghost > 0) {
+        // Jacobi con celdas fantasma de ancho ghost: un intercambio cada ghost sweeps
+        stats.sweeps = deep_jacobi(n, nsteps, ghost, u_local, local_n, local_start,
+                                   rank, size, &halo, half_sweep, sweep_res, &opts, &stats,
+                                   norms_type, norms_reduce);
+    } else {
+        // Iteraciones Jacobi (o Chebyshev) con MPI
+        int step;
+        double w = 1.0;  // peso de Chebyshev del último sweep
+        for(step = 0; step < nsteps; step++) {
+            // Cada tanto el primer sweep también mide el residuo: parcial por hilo,
+            // reducción OpenMP dentro del proceso y un Allreduce entre procesos
+            int check = jacobi_check_due(&opts, 2*step);
+            double sumsq = 0, linf = 0;
+
+            if (fused_sweep) {
+                // Los dos sweeps en una pasada sobre u_local, con las dos
+                // celdas fantasma de cada lado
+                exchange_ghosts(&halo, u_local, NG);
+                #pragma omp parallel reduction(+:sumsq) reduction(max:linf)
+                {
+                    int tlo, thi;
+                    double halo[4];
+                    thread_range(lo, hi, &tlo, &thi);
+                    int flags = jacobi_halo(u_local, tlo, thi,
+                                            rank == 0 && tlo == lo,
+                                            rank == size - 1 && thi == hi, halo);
+                    // nadie sobrescribe u_local hasta que todos guardaron sus vecinos
+                    #pragma omp barrier
+                    if (check) {
+                        double norms[2] = { 0, 0 };
+                        fused_res(u_local, f_local, h2, tlo, thi, halo, flags, norms);
+                        sumsq = norms[0];
+                        linf  = norms[1];
+                    } else {
+                        fused_sweep(u_local, f_local, h2, tlo, thi, halo, flags);
+                    }
+                }
+            } else {
+                // Dos medios barridos, cada uno con las celdas fantasma de
+                // su arreglo de entrada recién intercambiadas (el segundo
+                // lee las de utmp_local).  Chebyshev: utmp_local y u_local
+                // guardan también la iteración previa; el peso cambia en
+                // cada sweep y todos lo calculan igual
+                sweep_kind_t kind = { half_sweep, sweep_res,
+                                      opts.solver == JACOBI_SOLVER_CHEBYSHEV, 1.0 };
+                double norms[2] = { 0, 0 };
+                if (kind.chebyshev) kind.w = jacobi_chebyshev_omega(n, 2*step, w);
+                halo_sweep(&kind, utmp_local, u_local, f_local, h2, &halo, lo, hi,
+                           comm, check ? norms : NULL);
+                if (kind.chebyshev) kind.w = w = jacobi_chebyshev_omega(n, 2*step + 1, kind.w);
+                halo_sweep(&kind, u_local, utmp_local, f_local, h2, &halo, lo, hi,
+                           comm, NULL);
+                sumsq = norms[0];
+                linf  = norms[1];
+            }
         
-        // Segundo sweep
-        #pragma omp parallel for schedule(static)
-        for(int i = 1; i <= local_n; i++) {
-            int left = (i == 1 && rank == 0) ? utmp_local[1] : utmp_local[i-1];
-            int right = (i == local_n && rank == size - 1) ? utmp_local[local_n] : utmp_local[i+1];
-            u_local[i] = (left + right + h2 * f_local[i]) * 0.5;
+            // Todos los procesos reciben la misma suma y toman la misma decisión
+            if (check) {
+                double norms[2] = { sumsq, linf };
+                MPI_Allreduce(MPI_IN_PLACE, norms, 1, norms_type, norms_reduce, MPI_COMM_WORLD);
+                if (jacobi_converged(&opts, &stats, 2*step, norms, h)) {
+                    step++;
+                    break;
+                }
+            }
         }
+        stats.sweeps = 2*step;
     }
 
     if (rank == 0) {
         get_time(&tend);
-        printf("n: %d\nnsteps: %d\nnum_processes: %d\nnum_threads_per_process: %d\nElapsed time: %Lf s\n",
-               n, nsteps, size, num_threads, timespec_diff(tstart, tend));
+        printf("n: %d\nnsteps: %d\nnum_processes: %d\nnum_threads_per_process: %d\nsolver: %s\nsweep: %s\ncomm: %s\nhalo: %s\nkernel: %s\nElapsed time: %Lf s\n",
+               n, nsteps, size, num_threads, jacobi_solver_name(opts.solver),
+               fused_sweep ? "fused" : "split", comm_names[comm], halo_names[halo.mode],
+               jacobi_kernel_name(half_sweep),
+               timespec_diff(tstart, tend));
+        if (ghost > 0 && model[0] > 0)
+            printf("ghost: %d (auto: latencia %.2f us, %.2f ns por punto)\n",
+                   ghost, 1e6 * model[0], 1e9 * model[1]);
+        else if (ghost > 0)
+            printf("ghost: %d\n", ghost);
+        jacobi_print_stats(&opts, &stats);
     }
 
-    // Recopilar resultados en el proceso 0 para escritura de archivo
-    if(fname && rank == 0) {
-        double *u_global = malloc((n + 1) * sizeof(double));
-        
-        // Copiar datos locales del proceso 0
-        for(int i = 1; i <= local_n; i++) {
-            u_global[local_start + i - 1] = u_local[i];
-        }
-        
-        // Recibir datos de otros procesos
-        for(int p = 1; p < size; p++) {
-            int p_local_n = n / size;
-            if (p < remainder) p_local_n++;
-            int p_start = p * (n / size) + (p < remainder ? p : remainder);
-            
-            MPI_Recv(&u_global[p_start], p_local_n, MPI_DOUBLE, p, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        }
-        
-        // Escribir archivo
-        FILE* fp = fopen(fname, "w");
-        for(int i = 0; i <= n; i++) fprintf(fp, "%g %g\n", i*h, u_global[i]);
-        fclose(fp);
-        
-        free(u_global);
-    } else if(fname && rank != 0) {
-        // Enviar datos locales al proceso 0
-        MPI_Send(&u_local[1], local_n, MPI_DOUBLE, 0, 2, MPI_COMM_WORLD);
+    // Error contra la solución directa, calculada en otro arreglo con los
+    // mismos valores de frontera
+    if (opts.error) {
+        double *ref = malloc((local_n + 2*NG) * sizeof(double));
+        double err = 0;
+        memcpy(ref, u_local, (local_n + 2*NG) * sizeof(double));
+        direct_mpi(n, ref, f_local, h2, lo, NG + local_n - 1, utmp_local, rank, size);
+        for (int i = NG; i < NG + local_n; i++)
+            if (fabs(u_local[i] - ref[i]) > err) err = fabs(u_local[i] - ref[i]);
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &err, &err, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) printf("error vs direct: %g\n", err);
+        free(ref);
+    }
+
+    // Escribir la solución: con MPI-IO cada proceso escribe su parte
+    if (fname) {
+        int out = output_mode();
+        double t = MPI_Wtime();
+        if (out == OUTPUT_GATHER)
+            write_gather(fname, &u_local[NG], local_n, local_start, n, h, rank, size);
+        else
+            write_mpiio(fname, out, &u_local[NG], local_n, local_start, n, h, rank);
+        t = MPI_Wtime() - t;
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &t, &t, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) printf("output: %s (%.6f s)\n", output_names[out], t);
     }
 
-    free(u_local); 
-    free(utmp_local); 
     free(f_local);
+    halo_free(&halo);
     
+    MPI_Op_free(&norms_reduce);
+    MPI_Type_free(&norms_type);
     MPI_Finalize();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "multigrid.h"
+#include "tridiag.h"
+
+/* Ranges shorter than this are not worth a parallel region */
+#define MG_OMP_GRAIN 8192
+
+void mg_smooth(double* dst, const double* src, const double* f,
+               double h2, int lo, int hi)
+{
+    int i;
+    double c = h2/2;
+
+    #pragma omp parallel for schedule(static) if (hi - lo > MG_OMP_GRAIN)
+    for (i = lo; i < hi; ++i) {
+        double t = (src[i-1] + src[i+1])*0.5 + c*f[i];
+        dst[i] = src[i] + MG_OMEGA*(t - src[i]);
+    }
+}
+
+void mg_residual(double* r, const double* u, const double* f,
+                 double h2, int lo, int hi, double norms[2])
+{
+    int i;
+    double sumsq = 0, maxabs = 0;
+
+    if (norms == NULL) {
+        #pragma omp parallel for schedule(static) if (hi - lo > MG_OMP_GRAIN)
+        for (i = lo; i < hi; ++i)
+            r[i] = f[i] + (u[i-1] - 2*u[i] + u[i+1]) / h2;
+        return;
+    }
+
+    #pragma omp parallel for schedule(static) if (hi - lo > MG_OMP_GRAIN) \
+        reduction(+:sumsq) reduction(max:maxabs)
+    for (i = lo; i < hi; ++i) {
+        double ri = f[i] + (u[i-1] - 2*u[i] + u[i+1]) / h2;
+        r[i] = ri;
+        sumsq += ri*ri;
+        if (fabs(ri) > maxabs)
+            maxabs = fabs(ri);
+    }
+    norms[0] += sumsq;
+    if (maxabs > norms[1])
+        norms[1] = maxabs;
+}
+
+void mg_restrict(double* fc, const double* r, int lo, int hi, int off)
+{
+    int I;
+
+    #pragma omp parallel for schedule(static) if (hi - lo > MG_OMP_GRAIN)
+    for (I = lo; I < hi; ++I) {
+        const double* ri = r + 2*I + off;
+        fc[I] = (ri[-1] + 2*ri[0] + ri[1]) * 0.25;
+    }
+}
+
+void mg_prolong(double* u, const double* e, int lo, int hi, int off)
+{
+    int i;
+
+    #pragma omp parallel for schedule(static) if (hi - lo > MG_OMP_GRAIN)
+    for (i = lo; i < hi; ++i) {
+        int j = i - off;
+        u[i] += (j & 1) ? (e[j>>1] + e[(j>>1) + 1]) * 0.5 : e[j>>1];
+    }
+}
+
+void mg_direct(int n, double* u, const double* f, double* work)
+{
+    tridiag_solve(n, u, f, work);
+}
+
+
+/* --
+ * Level hierarchy.  Level 0 uses the caller's u and f; r doubles as the
+ * second buffer of the smoother.
+ */
+typedef struct {
+    int nlevels;
+    int n[MG_MAX_LEVELS];
+    double* u[MG_MAX_LEVELS];
+    double* f[MG_MAX_LEVELS];
+    double* r[MG_MAX_LEVELS];
+    double* work;
+} mg_t;
+
+static void mg_setup(mg_t* mg, int n, double* u, double* f)
+{
+    int l;
+
+    mg->n[0] = n;
+    mg->u[0] = u;
+    mg->f[0] = f;
+    mg->r[0] = (double*) calloc(n+1, sizeof(double));
+    for (l = 1; l < MG_MAX_LEVELS && n % 2 == 0 && n/2 >= 2; ++l) {
+        n /= 2;
+        mg->n[l] = n;
+        mg->u[l] = (double*) calloc(n+1, sizeof(double));
+        mg->f[l] = (double*) calloc(n+1, sizeof(double));
+        mg->r[l] = (double*) calloc(n+1, sizeof(double));
+    }
+    mg->nlevels = l;
+    mg->work = (double*) malloc((n+1) * sizeof(double));
+}
+
+static void mg_free(mg_t* mg)
+{
+    int l;
+
+    free(mg->r[0]);
+    for (l = 1; l < mg->nlevels; ++l) {
+        free(mg->u[l]);
+        free(mg->f[l]);
+        free(mg->r[l]);
+    }
+    free(mg->work);
+}
+
+/* nsweeps damped Jacobi sweeps on level l, two at a time through r */
+static void mg_relax(mg_t* mg, int l, int nsweeps)
+{
+    int sweep, n = mg->n[l];
+    double h2 = 1.0 / ((double) n * n);
+    double* u = mg->u[l];
+    double* r = mg->r[l];
+
+    r[0] = u[0];
+    r[n] = u[n];
+    for (sweep = 0; sweep < nsweeps; sweep += 2) {
+        mg_smooth(r, u, mg->f[l], h2, 1, n);
+        mg_smooth(u, r, mg->f[l], h2, 1, n);
+    }
+}
+
+static void mg_vcycle(mg_t* mg, int l)
+{
+    int n = mg->n[l];
+    double h2 = 1.0 / ((double) n * n);
+
+    if (l == mg->nlevels - 1) {
+        mg_direct(n, mg->u[l], mg->f[l], mg->work);
+        return;
+    }
+
+    mg_relax(mg, l, MG_PRE_SWEEPS);
+
+    /* Coarse-grid equation for the error: A_c e = R r, e = 0 on the boundary */
+    mg_residual(mg->r[l], mg->u[l], mg->f[l], h2, 1, n, NULL);
+    mg_restrict(mg->f[l+1], mg->r[l], 1, mg->n[l+1], 0);
+    memset(mg->u[l+1], 0, (mg->n[l+1] + 1) * sizeof(double));
+    mg_vcycle(mg, l+1);
+    mg_prolong(mg->u[l], mg->u[l+1], 1, n, 0);
+
+    mg_relax(mg, l, MG_POST_SWEEPS);
+}
+
+/* --
+ * Full multigrid: restrict f and the boundary values to every level,
+ * solve the coarsest exactly, then interpolate each solution up as the
+ * initial guess of one V-cycle on the next finer level.
+ */
+static void mg_fmg(mg_t* mg)
+{
+    int l;
+
+    for (l = 0; l < mg->nlevels - 1; ++l) {
+        mg_restrict(mg->f[l+1], mg->f[l], 1, mg->n[l+1], 0);
+        mg->u[l+1][0] = mg->u[l][0];
+        mg->u[l+1][mg->n[l+1]] = mg->u[l][mg->n[l]];
+    }
+    mg_direct(mg->n[l], mg->u[l], mg->f[l], mg->work);
+    for (l = mg->nlevels - 2; l >= 0; --l) {
+        memset(mg->u[l] + 1, 0, (mg->n[l] - 1) * sizeof(double));
+        mg_prolong(mg->u[l], mg->u[l+1], 1, mg->n[l], 0);
+        mg_vcycle(mg, l);
+    }
+}
+
+int mg_solve(int n, double* u, double* f, int fmg, int maxcycles,
+             const jacobi_opts_t* opts, jacobi_stats_t* stats)
+{
+    int cycles = 0, done = 0;
+    double h2 = 1.0 / ((double) n * n);
+    double norms[2];
+    mg_t mg;
+
+    mg_setup(&mg, n, u, f);
+    if (fmg && maxcycles > 0) {
+        mg_fmg(&mg);
+        cycles = 1;
+    }
+    for (;;) {
+        if (opts && opts->check > 0) {
+            norms[0] = norms[1] = 0;
+            mg_residual(mg.r[0], u, f, h2, 1, n, norms);
+            done = jacobi_converged(opts, stats, cycles, norms, 1.0 / n);
+        }
+        if (done || cycles >= maxcycles)
+            break;
+        mg_vcycle(&mg, 0);
+        ++cycles;
+    }
+    mg_free(&mg);
+
+    if (stats)
+        stats->sweeps = cycles;
+    return cycles;
+}
@@ -0,0 +1,75 @@
+#ifndef TRIDIAG_H_
+#define TRIDIAG_H_
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* --
+ * Direct solvers for the tridiagonal system the Jacobi sweeps iterate
+ * on, the n+1 point discretization of -u'' = f on [0,1]:
+ *
+ *    (-u[i-1] + 2 u[i] - u[i+1]) / h^2 = f[i],   0 < i < n
+ *
+ * with Dirichlet values u[0] and u[n].  The Thomas algorithm solves it
+ * exactly in O(n), so it also gives the reference solution iterative
+ * runs measure their error against.
+ */
+
+/* --
+ * Thomas algorithm over the whole mesh, in place: reads u[0], u[n] and
+ * f, writes u[1 .. n-1].  work holds at least n+1 doubles.
+ */
+void tridiag_solve(int n, double* u, const double* f, double* work);
+
+/* --
+ * Partitioned solver (SPIKE with the spikes in closed form).  The mesh
+ * is cut at separator points sep[0] = 0 < sep[1] < ... < sep[nparts] = n
+ * and part p is the open interval (sep[p], sep[p+1]).  Three phases:
+ *
+ *  1. tridiag_block() solves every part with zero values at both ends,
+ *     independently of the others (threads or ranks in parallel).
+ *  2. tridiag_interface() solves the small nparts-1 system for u at the
+ *     separators; it only needs the first and last value of each part.
+ *  3. tridiag_correct() adds the solution of the homogeneous problem
+ *     between the two separators of each part.  For -u'' = 0 this is
+ *     the straight line through the end values, so the spikes of SPIKE
+ *     never have to be computed or stored.
+ *
+ * The result equals the Thomas solution up to rounding.
+ */
+
+/* --
+ * Solve over [lo, hi) with u[lo-1] = u[hi] = 0 (never read), writing
+ * u[lo .. hi-1].  work[lo .. hi-1] is used as scratch.
+ */
+void tridiag_block(double* u, const double* f, double h2,
+                   int lo, int hi, double* work);
+
+/* --
+ * Separator values.  y[2p] and y[2p+1] are the first and last values
+ * of part p after phase 1 (ignored for empty parts), fsep[q] is f at
+ * sep[q].  x[0] = u[0] and x[nparts] = u[n] on entry; x[1 .. nparts-1]
+ * get u at the separators.  work holds 2*nparts doubles.
+ */
+void tridiag_interface(int nparts, const int* sep, const double* y,
+                       const double* fsep, double h2, double* x,
+                       double* work);
+
+/* --
+ * Add to u[lo .. hi-1] the linear function that is left at lo-1 and
+ * right at hi.
+ */
+void tridiag_correct(double* u, int lo, int hi, double left, double right);
+
+/* --
+ * Max-norm difference between u and the Thomas solution for the same
+ * f and boundary values.
+ */
+double tridiag_error(int n, const double* u, const double* f);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* TRIDIAG_H_ */